@@ -17,4 +17,10 @@ if Project "imp-cli" then
     Compile "cli/**"
     Include "cli"
     Artifact { "out/imp", type = "Console" }
+end
+
+if Project "imp-test-basis-math" then
+    Import "imp"
+    Compile "test/basis_math/**"
+    Artifact { "out/imp-test-basis-math", type = "Console" }
 end
\ No newline at end of file
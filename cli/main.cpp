@@ -2,12 +2,41 @@
 
 #include <fmt/printf.h>
 
+// Discards streamed geometry, reporting totals
+
+struct CountingGeometrySink : imp::GeometrySink
+{
+    uint64_t pages = 0;
+    uint64_t ranges = 0;
+    uint64_t bytes = 0;
+
+    virtual void WriteGeometryBatch(const imp::GeometryBatch& batch) override
+    {
+        pages += batch.geometries.count;
+        ranges += batch.geometry_ranges.count;
+        for (uint32_t i = 0; i < batch.geometries.count; ++i) {
+            auto& geometry = batch.geometries[i];
+            bytes += geometry.indices.count * sizeof(uint32_t)
+                + geometry.compact_indices.count
+                + geometry.positions.count * sizeof(glm::vec3)
+                + geometry.tangent_spaces.count * sizeof(imp::Basis)
+                + geometry.tex_coords.count;
+        }
+    }
+};
+
 int main(int argc, char* argv[])
 {
     std::filesystem::path path;
+    uint64_t stream_budget_mib = 0;
     for (int i = 1; i < argc; ++i) {
         std::string_view arg = argv[i];
 
+        if (arg.starts_with("--stream-budget=")) {
+            stream_budget_mib = std::stoull(std::string(arg.substr(16)));
+            continue;
+        }
+
         path = arg;
     }
 
@@ -17,12 +46,26 @@ int main(int argc, char* argv[])
     }
 
     imp::Importer importer;
+    importer.settings.stream_memory_budget = stream_budget_mib << 20;
     importer.SetBaseDir(path.parent_path());
     importer.LoadFile(path);
     importer.ReportStatistics();
 
+    if (stream_budget_mib) {
+        CountingGeometrySink sink;
+        auto scene = importer.StreamScene(sink);
+
+        fmt::println("Scene[geometry pages = {}, geometry ranges = {}, meshes = {}], {} geometry bytes streamed",
+            sink.pages, sink.ranges, scene.meshes.count, sink.bytes);
+        fmt::println("Scene memory: {} used, {} reserved",
+            importer.memory_pool.BytesUsed(), importer.memory_pool.BytesReserved());
+        return 0;
+    }
+
     auto scene = importer.GenerateScene();
 
     fmt::println("Scene[geometries = {}, geometry ranges = {}, meshes = {}]",
         scene.geometries.count, scene.geometry_ranges.count, scene.meshes.count);
+    fmt::println("Scene memory: {} used, {} reserved",
+        importer.memory_pool.BytesUsed(), importer.memory_pool.BytesReserved());
 }
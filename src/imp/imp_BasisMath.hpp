@@ -1,5 +1,7 @@
 #pragma once
 
+#include "imp_Scene.hpp"
+
 #include <vendor/glm_include.hpp>
 
 namespace imp::detail
@@ -129,4 +131,50 @@ namespace imp::detail
 
         return packedTangent.x * t1 + packedTangent.y * t2;
     }
+
+// -----------------------------------------------------------------------------
+//                              Quantize Basis
+// -----------------------------------------------------------------------------
+
+    struct VertexBasis
+    {
+        glm::vec3 normal = {};
+        glm::vec3 tangent = {};
+        glm::vec3 bitangent = {};
+    };
+
+    inline
+    Basis QuantizeBasis(VertexBasis& basis_in)
+    {
+        Basis basis_out;
+
+        // Normalize and reorthogonalize generated tangent spaces
+
+        basis_in.normal = glm::normalize(basis_in.normal);
+        basis_in.tangent = glm::normalize(basis_in.tangent);
+        basis_in.tangent = Reorthogonalize(basis_in.tangent, basis_in.normal);
+        basis_in.bitangent = glm::normalize(basis_in.bitangent);
+
+        auto enc_normal = SignedOctEncode(basis_in.normal);
+        basis_out.oct_x = uint32_t(enc_normal.x * 1023.f);
+        basis_out.oct_y = uint32_t(enc_normal.y * 1023.f);
+        basis_out.oct_s = uint32_t(enc_normal.z);
+
+        // Decode quantized normal before computing tangent to
+        //  ensure consistent tangent basis
+
+        auto decoded_normal = SignedOctDecode(glm::vec3 {
+            float(basis_out.oct_x) / 1023.f,
+            float(basis_out.oct_y) / 1023.f,
+            float(basis_out.oct_s),
+        });
+
+        auto enc_tangent = EncodeTangent(decoded_normal, basis_in.tangent);
+        basis_out.tgt_a = uint32_t(enc_tangent * 1023.f);
+
+        auto enc_bitangent = glm::dot(glm::cross(basis_in.normal, basis_in.tangent), basis_in.bitangent) > 0.f;
+        basis_out.btg_s = uint32_t(enc_bitangent);
+
+        return basis_out;
+    }
 }
\ No newline at end of file
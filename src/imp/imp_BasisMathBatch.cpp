@@ -0,0 +1,350 @@
+#include "imp_BasisMathBatch.hpp"
+#include "imp_CpuFeatures.hpp"
+
+#ifdef IMP_X86
+#  include <immintrin.h>
+#endif
+
+namespace imp::detail
+{
+    static_assert(sizeof(Basis) == sizeof(uint32_t));
+}
+
+// -----------------------------------------------------------------------------
+//                                   Scalar
+// -----------------------------------------------------------------------------
+
+namespace imp::detail::basis_scalar
+{
+    static void SignedOctEncodeBatch(const Vec3Batch& in, Vec3Batch& out)
+    {
+        for (uint32_t i = 0; i < BasisBatchSize; ++i) {
+            out.Set(i, SignedOctEncode(in.Get(i)));
+        }
+    }
+
+    static void SignedOctDecodeBatch(const Vec3Batch& in, Vec3Batch& out)
+    {
+        for (uint32_t i = 0; i < BasisBatchSize; ++i) {
+            out.Set(i, SignedOctDecode(in.Get(i)));
+        }
+    }
+
+    static void EncodeTangentBatch(const Vec3Batch& normal, const Vec3Batch& tangent, float* out)
+    {
+        for (uint32_t i = 0; i < BasisBatchSize; ++i) {
+            out[i] = EncodeTangent(normal.Get(i), tangent.Get(i));
+        }
+    }
+
+    static void DecodeDiamondBatch(const float* in, Vec2Batch& out)
+    {
+        for (uint32_t i = 0; i < BasisBatchSize; ++i) {
+            auto v = DecodeDiamond(in[i]);
+            out.x[i] = v.x;
+            out.y[i] = v.y;
+        }
+    }
+
+    static void QuantizeBasisBatch(const VertexBasisBatch& in, Basis* out, uint32_t count)
+    {
+        for (uint32_t i = 0; i < count; ++i) {
+            VertexBasis basis {
+                .normal = in.normal.Get(i),
+                .tangent = in.tangent.Get(i),
+                .bitangent = in.bitangent.Get(i),
+            };
+            out[i] = QuantizeBasis(basis);
+        }
+    }
+
+    static void PackHalf2x16Batch(const glm::vec2* in, Vec2<Float16>* out, uint32_t count)
+    {
+        for (uint32_t i = 0; i < count; ++i) {
+            out[i] = std::bit_cast<Vec2<Float16>>(glm::packHalf2x16(in[i]));
+        }
+    }
+
+    constexpr BasisBatchKernels Kernels {
+        "Scalar",
+        &SignedOctEncodeBatch,
+        &SignedOctDecodeBatch,
+        &EncodeTangentBatch,
+        &DecodeDiamondBatch,
+        &QuantizeBasisBatch,
+        &PackHalf2x16Batch,
+    };
+}
+
+#ifdef IMP_X86
+
+// Lane types mirror the scalar glm semantics used in imp_BasisMath.hpp exactly, including
+//  operand order, so every lane rounds identically to the scalar code. Each instruction set is
+//  enabled only for its own namespace, FMA is never enabled so nothing is contracted.
+
+// -----------------------------------------------------------------------------
+//                                AVX2 + F16C
+// -----------------------------------------------------------------------------
+
+#if defined(__clang__)
+#  pragma clang attribute push(__attribute__((target("avx2,f16c"))), apply_to = function)
+#elif defined(__GNUC__)
+#  pragma GCC push_options
+#  pragma GCC target("avx2,f16c")
+#endif
+
+namespace imp::detail::basis_avx2
+{
+    struct Ints
+    {
+        __m256i v;
+
+        Ints operator&(uint32_t mask) const noexcept { return { _mm256_and_si256(v, _mm256_set1_epi32(int32_t(mask))) }; }
+        Ints operator|(Ints o)        const noexcept { return { _mm256_or_si256(v, o.v) }; }
+        Ints operator<<(int shift)    const noexcept { return { _mm256_slli_epi32(v, shift) }; }
+
+        void Store(uint32_t* p) const noexcept { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+    };
+
+    struct Floats
+    {
+        static constexpr uint32_t Width = 8;
+
+        __m256 v;
+
+        Floats() = default;
+        Floats(__m256 _v) : v(_v) {}
+        Floats(float f) : v(_mm256_set1_ps(f)) {}
+
+        static Floats Load(const float* p) noexcept { return { _mm256_load_ps(p) }; }
+        void Store(float* p) const noexcept { _mm256_store_ps(p, v); }
+    };
+
+    static Floats operator+(Floats a, Floats b) noexcept { return { _mm256_add_ps(a.v, b.v) }; }
+    static Floats operator-(Floats a, Floats b) noexcept { return { _mm256_sub_ps(a.v, b.v) }; }
+    static Floats operator*(Floats a, Floats b) noexcept { return { _mm256_mul_ps(a.v, b.v) }; }
+    static Floats operator/(Floats a, Floats b) noexcept { return { _mm256_div_ps(a.v, b.v) }; }
+    static Floats operator-(Floats a)           noexcept { return { _mm256_xor_ps(a.v, _mm256_set1_ps(-0.f)) }; }
+    static Floats operator&(Floats a, Floats b) noexcept { return { _mm256_and_ps(a.v, b.v) }; }
+
+    static Floats operator<(Floats a, Floats b) noexcept { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+    static Floats operator>(Floats a, Floats b) noexcept { return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+
+    static Floats Select(Floats mask, Floats a, Floats b) noexcept { return { _mm256_blendv_ps(b.v, a.v, mask.v) }; }
+    static Floats Sqrt(Floats a) noexcept { return { _mm256_sqrt_ps(a.v) }; }
+    static Floats Abs(Floats a)  noexcept { return { _mm256_andnot_ps(_mm256_set1_ps(-0.f), a.v) }; }
+
+    // glm::clamp(x, 0, 1) == min(max(x, 0), 1) with glm's NaN propagation
+    static Floats Saturate(Floats a) noexcept { return { _mm256_min_ps(_mm256_set1_ps(1.f), _mm256_max_ps(_mm256_setzero_ps(), a.v)) }; }
+
+    static Ints   Truncate(Floats a)  noexcept { return { _mm256_cvttps_epi32(a.v) }; }
+    static Floats ToFloat(Ints a)     noexcept { return { _mm256_cvtepi32_ps(a.v) }; }
+    static Ints   ToBool(Floats mask) noexcept { return { _mm256_srli_epi32(_mm256_castps_si256(mask.v), 31) }; }
+
+#include "imp_BasisMathBatchKernels.hpp"
+
+    static void PackHalf2x16Batch(const glm::vec2* in, Vec2<Float16>* out, uint32_t count)
+    {
+        uint32_t i = 0;
+
+        // F16C rounds to nearest-even while glm rounds ties away from zero and handles
+        //  subnormal rounding and signalling NaNs differently. Those (rare) inputs are
+        //  detected and recomputed with glm so that results remain bit-identical.
+
+        for (; i + 4 <= count; i += 4) {
+            __m256 v = _mm256_loadu_ps(&in[i].x);
+            __m128i halves = _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), halves);
+
+            __m256i bits = _mm256_castps_si256(v);
+            __m256i exp = _mm256_and_si256(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(0xFF));
+            __m256i tie = _mm256_and_si256(
+                _mm256_cmpeq_epi32(_mm256_and_si256(bits, _mm256_set1_epi32(0x1FFF)), _mm256_set1_epi32(0x1000)),
+                _mm256_cmpgt_epi32(exp, _mm256_set1_epi32(112)));
+            __m256i subnormal = _mm256_and_si256(
+                _mm256_cmpgt_epi32(exp, _mm256_set1_epi32(101)),
+                _mm256_cmpgt_epi32(_mm256_set1_epi32(113), exp));
+            __m256i nan = _mm256_cmpeq_epi32(exp, _mm256_set1_epi32(0xFF));
+
+            uint32_t fixup = uint32_t(_mm256_movemask_ps(_mm256_castsi256_ps(
+                _mm256_or_si256(tie, _mm256_or_si256(subnormal, nan)))));
+
+            // Two float lanes per output element
+
+            for (uint32_t j = 0; fixup; ++j, fixup >>= 2) {
+                if (fixup & 0x3) {
+                    out[i + j] = std::bit_cast<Vec2<Float16>>(glm::packHalf2x16(in[i + j]));
+                }
+            }
+        }
+
+        for (; i < count; ++i) {
+            out[i] = std::bit_cast<Vec2<Float16>>(glm::packHalf2x16(in[i]));
+        }
+    }
+
+    constexpr BasisBatchKernels Kernels {
+        "AVX2",
+        &SignedOctEncodeBatch,
+        &SignedOctDecodeBatch,
+        &EncodeTangentBatch,
+        &DecodeDiamondBatch,
+        &QuantizeBasisBatch,
+        &PackHalf2x16Batch,
+    };
+}
+
+#if defined(__clang__)
+#  pragma clang attribute pop
+#elif defined(__GNUC__)
+#  pragma GCC pop_options
+#endif
+
+// -----------------------------------------------------------------------------
+//                                  SSE4.1
+// -----------------------------------------------------------------------------
+
+#if defined(__clang__)
+#  pragma clang attribute push(__attribute__((target("sse4.1"))), apply_to = function)
+#elif defined(__GNUC__)
+#  pragma GCC push_options
+#  pragma GCC target("sse4.1")
+#endif
+
+namespace imp::detail::basis_sse4
+{
+    struct Ints
+    {
+        __m128i v;
+
+        Ints operator&(uint32_t mask) const noexcept { return { _mm_and_si128(v, _mm_set1_epi32(int32_t(mask))) }; }
+        Ints operator|(Ints o)        const noexcept { return { _mm_or_si128(v, o.v) }; }
+        Ints operator<<(int shift)    const noexcept { return { _mm_slli_epi32(v, shift) }; }
+
+        void Store(uint32_t* p) const noexcept { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+    };
+
+    struct Floats
+    {
+        static constexpr uint32_t Width = 4;
+
+        __m128 v;
+
+        Floats() = default;
+        Floats(__m128 _v) : v(_v) {}
+        Floats(float f) : v(_mm_set1_ps(f)) {}
+
+        static Floats Load(const float* p) noexcept { return { _mm_load_ps(p) }; }
+        void Store(float* p) const noexcept { _mm_store_ps(p, v); }
+    };
+
+    static Floats operator+(Floats a, Floats b) noexcept { return { _mm_add_ps(a.v, b.v) }; }
+    static Floats operator-(Floats a, Floats b) noexcept { return { _mm_sub_ps(a.v, b.v) }; }
+    static Floats operator*(Floats a, Floats b) noexcept { return { _mm_mul_ps(a.v, b.v) }; }
+    static Floats operator/(Floats a, Floats b) noexcept { return { _mm_div_ps(a.v, b.v) }; }
+    static Floats operator-(Floats a)           noexcept { return { _mm_xor_ps(a.v, _mm_set1_ps(-0.f)) }; }
+    static Floats operator&(Floats a, Floats b) noexcept { return { _mm_and_ps(a.v, b.v) }; }
+
+    static Floats operator<(Floats a, Floats b) noexcept { return { _mm_cmplt_ps(a.v, b.v) }; }
+    static Floats operator>(Floats a, Floats b) noexcept { return { _mm_cmpgt_ps(a.v, b.v) }; }
+
+    static Floats Select(Floats mask, Floats a, Floats b) noexcept { return { _mm_blendv_ps(b.v, a.v, mask.v) }; }
+    static Floats Sqrt(Floats a) noexcept { return { _mm_sqrt_ps(a.v) }; }
+    static Floats Abs(Floats a)  noexcept { return { _mm_andnot_ps(_mm_set1_ps(-0.f), a.v) }; }
+
+    // glm::clamp(x, 0, 1) == min(max(x, 0), 1) with glm's NaN propagation
+    static Floats Saturate(Floats a) noexcept { return { _mm_min_ps(_mm_set1_ps(1.f), _mm_max_ps(_mm_setzero_ps(), a.v)) }; }
+
+    static Ints   Truncate(Floats a)  noexcept { return { _mm_cvttps_epi32(a.v) }; }
+    static Floats ToFloat(Ints a)     noexcept { return { _mm_cvtepi32_ps(a.v) }; }
+    static Ints   ToBool(Floats mask) noexcept { return { _mm_srli_epi32(_mm_castps_si128(mask.v), 31) }; }
+
+#include "imp_BasisMathBatchKernels.hpp"
+
+    constexpr BasisBatchKernels Kernels {
+        "SSE4.1",
+        &SignedOctEncodeBatch,
+        &SignedOctDecodeBatch,
+        &EncodeTangentBatch,
+        &DecodeDiamondBatch,
+        &QuantizeBasisBatch,
+        &basis_scalar::PackHalf2x16Batch,
+    };
+}
+
+#if defined(__clang__)
+#  pragma clang attribute pop
+#elif defined(__GNUC__)
+#  pragma GCC pop_options
+#endif
+
+#endif // IMP_X86
+
+namespace imp::detail
+{
+    const BasisBatchKernels& GetBasisBatchKernels()
+    {
+        static const BasisBatchKernels& kernels = []() -> const BasisBatchKernels& {
+#ifdef IMP_X86
+            auto& features = GetCpuFeatures();
+            if (features.avx2 && features.f16c) {
+                return basis_avx2::Kernels;
+            }
+            if (features.sse4_1) {
+                return basis_sse4::Kernels;
+            }
+#endif
+            return basis_scalar::Kernels;
+        }();
+        return kernels;
+    }
+
+// -----------------------------------------------------------------------------
+//                                 Batch API
+// -----------------------------------------------------------------------------
+
+    void SignedOctEncodeBatch(const Vec3Batch& in, Vec3Batch& out)
+    {
+        GetBasisBatchKernels().signed_oct_encode(in, out);
+    }
+
+    void SignedOctDecodeBatch(const Vec3Batch& in, Vec3Batch& out)
+    {
+        GetBasisBatchKernels().signed_oct_decode(in, out);
+    }
+
+    void EncodeTangentBatch(const Vec3Batch& normal, const Vec3Batch& tangent, float* out)
+    {
+        GetBasisBatchKernels().encode_tangent(normal, tangent, out);
+    }
+
+    void DecodeDiamondBatch(const float* in, Vec2Batch& out)
+    {
+        GetBasisBatchKernels().decode_diamond(in, out);
+    }
+
+    void QuantizeBasisBatch(const VertexBasisBatch& in, Basis* out, uint32_t count)
+    {
+        GetBasisBatchKernels().quantize_basis(in, out, count);
+    }
+
+    void PackHalf2x16Batch(const glm::vec2* in, Vec2<Float16>* out, uint32_t count)
+    {
+        GetBasisBatchKernels().pack_half_2x16(in, out, count);
+    }
+
+    std::vector<const BasisBatchKernels*> GetSimdBasisBatchKernels()
+    {
+        std::vector<const BasisBatchKernels*> kernels;
+#ifdef IMP_X86
+        auto& features = GetCpuFeatures();
+        if (features.sse4_1) {
+            kernels.push_back(&basis_sse4::Kernels);
+        }
+        if (features.avx2 && features.f16c) {
+            kernels.push_back(&basis_avx2::Kernels);
+        }
+#endif
+        return kernels;
+    }
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "imp_BasisMath.hpp"
+
+#include <vector>
+
+namespace imp::detail
+{
+    // Structure-of-arrays batch versions of the basis math kernels. Each call processes
+    //  BasisBatchSize lanes, selecting AVX2 (with F16C), SSE4.1 or a scalar fallback at
+    //  runtime from the CPU's features. All outputs are bit-identical to the scalar functions,
+    //  provided the scalar path is not compiled with floating point contraction (FMA fusion)
+    //  enabled.
+
+    constexpr uint32_t BasisBatchSize = 8;
+
+    struct Vec2Batch
+    {
+        alignas(32) float x[BasisBatchSize];
+        alignas(32) float y[BasisBatchSize];
+    };
+
+    struct Vec3Batch
+    {
+        alignas(32) float x[BasisBatchSize];
+        alignas(32) float y[BasisBatchSize];
+        alignas(32) float z[BasisBatchSize];
+
+        void Set(uint32_t lane, glm::vec3 v) noexcept
+        {
+            x[lane] = v.x;
+            y[lane] = v.y;
+            z[lane] = v.z;
+        }
+
+        glm::vec3 Get(uint32_t lane) const noexcept
+        {
+            return { x[lane], y[lane], z[lane] };
+        }
+    };
+
+    struct VertexBasisBatch
+    {
+        Vec3Batch normal;
+        Vec3Batch tangent;
+        Vec3Batch bitangent;
+
+        void Set(uint32_t lane, const VertexBasis& basis) noexcept
+        {
+            normal.Set(lane, basis.normal);
+            tangent.Set(lane, basis.tangent);
+            bitangent.Set(lane, basis.bitangent);
+        }
+    };
+
+    void SignedOctEncodeBatch(const Vec3Batch& in, Vec3Batch& out);
+    void SignedOctDecodeBatch(const Vec3Batch& in, Vec3Batch& out);
+    void EncodeTangentBatch(const Vec3Batch& normal, const Vec3Batch& tangent, float* out);
+    void DecodeDiamondBatch(const float* in, Vec2Batch& out);
+
+    // Equivalent to QuantizeBasis for each lane, writes the first count lanes to out
+
+    void QuantizeBasisBatch(const VertexBasisBatch& in, Basis* out, uint32_t count = BasisBatchSize);
+
+    // Equivalent to glm::packHalf2x16 for each of count elements
+
+    void PackHalf2x16Batch(const glm::vec2* in, Vec2<Float16>* out, uint32_t count = BasisBatchSize);
+
+    // Batch kernels of one instruction set
+
+    struct BasisBatchKernels
+    {
+        const char* name;
+        void (*signed_oct_encode)(const Vec3Batch& in, Vec3Batch& out);
+        void (*signed_oct_decode)(const Vec3Batch& in, Vec3Batch& out);
+        void (*encode_tangent)(const Vec3Batch& normal, const Vec3Batch& tangent, float* out);
+        void (*decode_diamond)(const float* in, Vec2Batch& out);
+        void (*quantize_basis)(const VertexBasisBatch& in, Basis* out, uint32_t count);
+        void (*pack_half_2x16)(const glm::vec2* in, Vec2<Float16>* out, uint32_t count);
+    };
+
+    // Kernels used by the batch functions above
+
+    const BasisBatchKernels& GetBasisBatchKernels();
+
+    // SIMD kernels of every instruction set the CPU supports, for checking against the scalar functions
+
+    std::vector<const BasisBatchKernels*> GetSimdBasisBatchKernels();
+}
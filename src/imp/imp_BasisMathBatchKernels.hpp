@@ -0,0 +1,188 @@
+// Lane width independent batch kernels. Included once per instruction set by
+//  imp_BasisMathBatch.cpp, inside a namespace defining Floats and Ints lane types with the
+//  instruction set enabled, so this file has no include guard.
+
+    struct Floats2 { Floats x, y; };
+    struct Floats3 { Floats x, y, z; };
+
+    static Floats3 Load(const Vec3Batch& b, uint32_t lane)
+    {
+        return { Floats::Load(b.x + lane), Floats::Load(b.y + lane), Floats::Load(b.z + lane) };
+    }
+
+    static void Store(Vec3Batch& b, uint32_t lane, const Floats3& v)
+    {
+        v.x.Store(b.x + lane);
+        v.y.Store(b.y + lane);
+        v.z.Store(b.z + lane);
+    }
+
+// -----------------------------------------------------------------------------
+//                                  Kernels
+// -----------------------------------------------------------------------------
+
+    static Floats Sign(Floats a)
+    {
+        return ((Floats(0.f) < a) & Floats(1.f)) - ((a < Floats(0.f)) & Floats(1.f));
+    }
+
+    static Floats Dot(const Floats3& a, const Floats3& b)
+    {
+        return a.x * b.x + a.y * b.y + a.z * b.z;
+    }
+
+    static Floats3 Cross(const Floats3& a, const Floats3& b)
+    {
+        return {
+            a.y * b.z - b.y * a.z,
+            a.z * b.x - b.z * a.x,
+            a.x * b.y - b.x * a.y,
+        };
+    }
+
+    static Floats3 Normalize(const Floats3& v)
+    {
+        Floats inv = Floats(1.f) / Sqrt(Dot(v, v));
+        return { v.x * inv, v.y * inv, v.z * inv };
+    }
+
+    static Floats3 Reorthogonalize(const Floats3& v, const Floats3& other)
+    {
+        Floats d = Dot(v, other);
+        return Normalize({ v.x - d * other.x, v.y - d * other.y, v.z - d * other.z });
+    }
+
+    static Floats3 SignedOctEncode(Floats3 n)
+    {
+        Floats3 out;
+
+        Floats sum = Abs(n.x) + Abs(n.y) + Abs(n.z);
+        n = { n.x / sum, n.y / sum, n.z / sum };
+
+        out.y = n.y *  Floats(0.5f) + Floats(0.5f);
+        out.x = n.x *  Floats(0.5f) + out.y;
+        out.y = n.x * Floats(-0.5f) + out.y;
+
+        out.z = Saturate(n.z * Floats(FLT_MAX));
+        return out;
+    }
+
+    static Floats3 SignedOctDecode(const Floats3& n)
+    {
+        Floats3 out;
+
+        out.x = n.x - n.y;
+        out.y = (n.x + n.y) - Floats(1.f);
+        out.z = n.z * Floats(2.f) - Floats(1.f);
+        out.z = out.z * (Floats(1.f) - Abs(out.x) - Abs(out.y));
+
+        return Normalize(out);
+    }
+
+    static Floats EncodeDiamond(Floats px, Floats py)
+    {
+        Floats x = px / (Abs(px) + Abs(py));
+        Floats py_sign = Sign(py);
+        return -py_sign * Floats(0.25f) * x + Floats(0.5f) + py_sign * Floats(0.25f);
+    }
+
+    static Floats EncodeTangent(const Floats3& normal, const Floats3& tangent)
+    {
+        Floats use_z0 = Abs(normal.y) > Abs(normal.z);
+        Floats3 t1 = Normalize({
+            Select(use_z0, normal.y, normal.z),
+            Select(use_z0, -normal.x, Floats(0.f)),
+            Select(use_z0, Floats(0.f), -normal.x),
+        });
+
+        Floats3 t2 = Cross(t1, normal);
+
+        return EncodeDiamond(Dot(tangent, t1), Dot(tangent, t2));
+    }
+
+    static Floats2 DecodeDiamond(Floats p)
+    {
+        Floats2 v;
+
+        Floats p_sign = Sign(p - Floats(0.5f));
+        v.x = -p_sign * Floats(4.f) * p + Floats(1.f) + p_sign * Floats(2.f);
+        v.y = p_sign * (Floats(1.f) - Abs(v.x));
+
+        Floats inv = Floats(1.f) / Sqrt(v.x * v.x + v.y * v.y);
+        return { v.x * inv, v.y * inv };
+    }
+
+// -----------------------------------------------------------------------------
+//                                 Batch API
+// -----------------------------------------------------------------------------
+
+    static void SignedOctEncodeBatch(const Vec3Batch& in, Vec3Batch& out)
+    {
+        for (uint32_t i = 0; i < BasisBatchSize; i += Floats::Width) {
+            Store(out, i, SignedOctEncode(Load(in, i)));
+        }
+    }
+
+    static void SignedOctDecodeBatch(const Vec3Batch& in, Vec3Batch& out)
+    {
+        for (uint32_t i = 0; i < BasisBatchSize; i += Floats::Width) {
+            Store(out, i, SignedOctDecode(Load(in, i)));
+        }
+    }
+
+    static void EncodeTangentBatch(const Vec3Batch& normal, const Vec3Batch& tangent, float* out)
+    {
+        alignas(32) float res[BasisBatchSize];
+        for (uint32_t i = 0; i < BasisBatchSize; i += Floats::Width) {
+            EncodeTangent(Load(normal, i), Load(tangent, i)).Store(res + i);
+        }
+        std::memcpy(out, res, sizeof(res));
+    }
+
+    static void DecodeDiamondBatch(const float* in, Vec2Batch& out)
+    {
+        alignas(32) float p[BasisBatchSize];
+        std::memcpy(p, in, sizeof(p));
+        for (uint32_t i = 0; i < BasisBatchSize; i += Floats::Width) {
+            auto v = DecodeDiamond(Floats::Load(p + i));
+            v.x.Store(out.x + i);
+            v.y.Store(out.y + i);
+        }
+    }
+
+    static void QuantizeBasisBatch(const VertexBasisBatch& in, Basis* out, uint32_t count)
+    {
+        uint32_t words[BasisBatchSize];
+
+        for (uint32_t i = 0; i < BasisBatchSize; i += Floats::Width) {
+
+            // Normalize and reorthogonalize generated tangent spaces
+
+            auto normal = Normalize(Load(in.normal, i));
+            auto tangent = Reorthogonalize(Normalize(Load(in.tangent, i)), normal);
+            auto bitangent = Normalize(Load(in.bitangent, i));
+
+            auto enc_normal = SignedOctEncode(normal);
+            auto oct_x = Truncate(enc_normal.x * Floats(1023.f)) & 0x3FF;
+            auto oct_y = Truncate(enc_normal.y * Floats(1023.f)) & 0x3FF;
+            auto oct_s = Truncate(enc_normal.z) & 0x1;
+
+            // Decode quantized normal before computing tangent to
+            //  ensure consistent tangent basis
+
+            auto decoded_normal = SignedOctDecode({
+                ToFloat(oct_x) / Floats(1023.f),
+                ToFloat(oct_y) / Floats(1023.f),
+                ToFloat(oct_s),
+            });
+
+            auto enc_tangent = EncodeTangent(decoded_normal, tangent);
+            auto tgt_a = Truncate(enc_tangent * Floats(1023.f)) & 0x3FF;
+
+            auto btg_s = ToBool(Dot(Cross(normal, tangent), bitangent) > Floats(0.f));
+
+            (oct_x | (oct_y << 10) | (oct_s << 20) | (tgt_a << 21) | (btg_s << 31)).Store(words + i);
+        }
+
+        std::memcpy(out, words, count * sizeof(Basis));
+    }
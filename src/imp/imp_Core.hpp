@@ -6,6 +6,7 @@
 #include <vendor/ankerl_hashes.hpp>
 
 #include <chrono>
+#include <span>
 
 namespace imp
 {
@@ -58,47 +59,152 @@ namespace imp
 
 // -----------------------------------------------------------------------------
 
+    // Chunked bump allocator. Allocations are carved linearly out of large aligned chunks,
+    //  individual allocations are never freed. Markers can be taken and rewound to in O(1)
+    //  to drop scratch allocations, chunks are retained for reuse until Release.
+    //  Not thread safe.
+
     struct MemoryPool
     {
-        std::vector<void*>                  allocations;
-        ankerl::unordered_dense::set<void*> freed;
+        static constexpr size_t DefaultChunkSize = 64ull << 20;
+        static constexpr size_t ChunkAlignment = 64;
+
+        struct Chunk
+        {
+            std::byte* data;
+            size_t     size;
+            size_t     used = 0;
+        };
+
+        struct Marker
+        {
+            size_t chunk_idx = 0;
+            size_t offset = 0;
+            size_t bytes_used = 0;
+        };
+
+        std::vector<Chunk> chunks;
+        size_t             chunk_size;
+        size_t             bytes_reserved = 0;
+        Marker             head;
 
     public:
+        MemoryPool(size_t _chunk_size = DefaultChunkSize)
+            : chunk_size(_chunk_size)
+        {}
+
+        MemoryPool(const MemoryPool&) = delete;
+        MemoryPool& operator=(const MemoryPool&) = delete;
+
         ~MemoryPool()
         {
-            Clear();
+            Release();
         }
 
+        // Rewinds all allocations, retaining chunks for reuse
+
         void Clear()
         {
-            for (auto* ptr : allocations) {
-                if (!freed.contains(ptr)) {
-                    free(ptr);
+            head = {};
+        }
+
+        // Frees all chunks
+
+        void Release()
+        {
+            for (auto& chunk : chunks) {
+                ::operator delete(chunk.data, std::align_val_t(ChunkAlignment));
+            }
+            chunks.clear();
+            bytes_reserved = 0;
+            head = {};
+        }
+
+        Marker GetMarker() const noexcept
+        {
+            return head;
+        }
+
+        void Rewind(const Marker& marker) noexcept
+        {
+            head = marker;
+        }
+
+        size_t BytesReserved() const noexcept
+        {
+            return bytes_reserved;
+        }
+
+        size_t BytesUsed() const noexcept
+        {
+            return head.bytes_used;
+        }
+
+        void* AllocateBytes(size_t size, size_t alignment = alignof(std::max_align_t))
+        {
+            // Try to fit in the current chunk, then any retained chunk after it
+
+            for (; head.chunk_idx < chunks.size(); ++head.chunk_idx, head.offset = 0) {
+                auto& chunk = chunks[head.chunk_idx];
+                size_t aligned = (head.offset + alignment - 1) & ~(alignment - 1);
+                if (aligned + size <= chunk.size) {
+                    head.bytes_used += (aligned - head.offset) + size;
+                    head.offset = aligned + size;
+                    return chunk.data + aligned;
                 }
+                chunk.used = head.offset;
             }
-            allocations.clear();
-            freed.clear();
+
+            // Allocate a new chunk, oversized allocations get a dedicated chunk
+
+            size_t new_size = std::max(chunk_size, size);
+            auto* data = static_cast<std::byte*>(::operator new(new_size, std::align_val_t(ChunkAlignment)));
+            chunks.push_back({ data, new_size, 0 });
+            bytes_reserved += new_size;
+
+            head.chunk_idx = chunks.size() - 1;
+            head.offset = size;
+            head.bytes_used += size;
+            return data;
         }
 
         template<class T>
         T* Allocate(size_t count)
         {
-            auto* ptr = static_cast<T*>(malloc(count * sizeof(T)));
-            if (ptr) {
-                allocations.push_back(ptr);
-            }
-            return ptr;
+            return static_cast<T*>(AllocateBytes(count * sizeof(T), std::max(alignof(T), alignof(std::max_align_t))));
         }
 
-        void Free(void* ptr)
+        // Invokes fn(std::span<const std::byte>) for each contiguous block of allocated memory
+
+        template<class Fn>
+        void ForEachBlock(Fn&& fn) const
         {
-            if (ptr) {
-                free(ptr);
-                freed.insert(ptr);
+            for (size_t i = 0; i < chunks.size() && i <= head.chunk_idx; ++i) {
+                size_t used = i == head.chunk_idx ? head.offset : chunks[i].used;
+                if (used) {
+                    fn(std::span<const std::byte>(chunks[i].data, used));
+                }
             }
         }
     };
 
+    struct MemoryScope
+    {
+        MemoryPool&        pool;
+        MemoryPool::Marker marker;
+
+    public:
+        MemoryScope(MemoryPool& _pool)
+            : pool(_pool)
+            , marker(_pool.GetMarker())
+        {}
+
+        ~MemoryScope()
+        {
+            pool.Rewind(marker);
+        }
+    };
+
     template<class T>
     struct Range
     {
@@ -107,7 +213,7 @@ namespace imp
 
         T& operator[](ptrdiff_t index) const noexcept
         {
-            return reinterpret_cast<T*>(reinterpret_cast<std::byte*>(begin))[index];
+            return begin[index];
         }
 
         Range Slice(size_t first, size_t _count = UINT64_MAX) const noexcept
@@ -115,9 +221,14 @@ namespace imp
             return { &(*this)[first], _count == UINT64_MAX ? (count - first) : _count };
         }
 
-        void CopyTo(Range<T> target) const noexcept
+        void CopyTo(Range<std::remove_const_t<T>> target) const noexcept
         {
             std::memcpy(target.begin, begin, count * sizeof(T));
         }
+
+        operator Range<const T>() const noexcept requires (!std::is_const_v<T>)
+        {
+            return { begin, count };
+        }
     };
 }
\ No newline at end of file
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#  define IMP_X86
+#  ifdef _MSC_VER
+#    include <intrin.h>
+#  else
+#    include <cpuid.h>
+#  endif
+#endif
+
+// Enables an instruction set for a single function, so SIMD paths are built without global
+//  arch flags and selected at runtime from GetCpuFeatures. MSVC accepts intrinsics for any
+//  instruction set without this.
+
+#if defined(__GNUC__) || defined(__clang__)
+#  define IMP_TARGET(isa) __attribute__((target(isa)))
+#else
+#  define IMP_TARGET(isa)
+#endif
+
+namespace imp
+{
+    struct CpuFeatures
+    {
+        bool ssse3 = false;
+        bool sse4_1 = false;
+        bool avx2 = false;
+        bool f16c = false;
+    };
+
+    inline
+    const CpuFeatures& GetCpuFeatures()
+    {
+        static const CpuFeatures features = [] {
+            CpuFeatures out;
+#ifdef IMP_X86
+            auto cpuid = [](uint32_t leaf, uint32_t (&regs)[4]) {
+#  ifdef _MSC_VER
+                __cpuidex(reinterpret_cast<int*>(regs), int(leaf), 0);
+#  else
+                __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#  endif
+            };
+
+            uint32_t regs[4];
+            cpuid(0, regs);
+            uint32_t max_leaf = regs[0];
+
+            cpuid(1, regs);
+            out.ssse3 = regs[2] & (1u << 9);
+            out.sse4_1 = regs[2] & (1u << 19);
+
+            // AVX registers are only usable when the OS saves their state (OSXSAVE + XCR0)
+
+            bool avx_state = false;
+            if ((regs[2] & (1u << 27)) && (regs[2] & (1u << 28))) {
+#  ifdef _MSC_VER
+                avx_state = (_xgetbv(0) & 0x6) == 0x6;
+#  else
+                uint32_t xcr0_lo, xcr0_hi;
+                __asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+                avx_state = (xcr0_lo & 0x6) == 0x6;
+#  endif
+            }
+            out.f16c = avx_state && (regs[2] & (1u << 29));
+
+            if (avx_state && max_leaf >= 7) {
+                cpuid(7, regs);
+                out.avx2 = regs[1] & (1u << 5);
+            }
+#endif
+            return out;
+        }();
+        return features;
+    }
+}
@@ -0,0 +1,164 @@
+#include "imp_FileMapping.hpp"
+
+#ifdef _WIN32
+#  ifndef NOMINMAX
+#    define NOMINMAX
+#  endif
+#  ifndef WIN32_LEAN_AND_MEAN
+#    define WIN32_LEAN_AND_MEAN
+#  endif
+#  include <Windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+namespace imp
+{
+    static size_t GetPageSize()
+    {
+#ifdef _WIN32
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return info.dwPageSize;
+#else
+        return size_t(sysconf(_SC_PAGESIZE));
+#endif
+    }
+
+    std::unique_ptr<MappedFile> MappedFile::Open(const std::filesystem::path& path, size_t min_padding)
+    {
+        auto file = std::make_unique<MappedFile>();
+        size_t page_size = GetPageSize();
+
+#ifdef _WIN32
+        HANDLE handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (handle == INVALID_HANDLE_VALUE) {
+            return nullptr;
+        }
+        file->file_handle = handle;
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(handle, &size)) {
+            return nullptr;
+        }
+        file->size = size_t(size.QuadPart);
+
+        if (file->size) {
+            HANDLE mapping_handle = CreateFileMappingW(handle, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+            if (!mapping_handle) {
+                return nullptr;
+            }
+            file->mapping_handle = mapping_handle;
+
+            file->mapping = MapViewOfFile(mapping_handle, FILE_MAP_COPY, 0, 0, 0);
+            if (!file->mapping) {
+                return nullptr;
+            }
+            file->mapping_size = file->size;
+            file->data = static_cast<std::byte*>(file->mapping);
+        }
+
+        // Views cannot extend past the end of the file, only the zeroed tail of the last page is
+        //  usable. Views always start at offset 0, so the allocation granularity (which only
+        //  constrains view offsets) plays no part here.
+
+        file->padding = (page_size - (file->size % page_size)) % page_size;
+        if (file->padding < min_padding) {
+            return nullptr;
+        }
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return nullptr;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            return nullptr;
+        }
+        file->size = size_t(st.st_size);
+
+        // Reserve an anonymous zeroed region large enough for the file and padding, then map
+        //  the file over the start of it. Bytes past the end of the file then always read as zero.
+
+        size_t file_pages = (file->size + page_size - 1) / page_size * page_size;
+        file->mapping_size = std::max((file->size + min_padding + page_size - 1) / page_size * page_size, page_size);
+
+        file->mapping = mmap(nullptr, file->mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (file->mapping == MAP_FAILED) {
+            file->mapping = nullptr;
+            close(fd);
+            return nullptr;
+        }
+
+        if (file->size && mmap(file->mapping, file_pages, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+            close(fd);
+            return nullptr;
+        }
+        close(fd);
+
+        file->data = static_cast<std::byte*>(file->mapping);
+        file->padding = file->mapping_size - file->size;
+#endif
+
+        return file;
+    }
+
+    MappedFile::~MappedFile()
+    {
+#ifdef _WIN32
+        if (mapping) {
+            UnmapViewOfFile(mapping);
+        }
+        if (mapping_handle) {
+            CloseHandle(mapping_handle);
+        }
+        if (file_handle) {
+            CloseHandle(file_handle);
+        }
+#else
+        if (mapping) {
+            munmap(mapping, mapping_size);
+        }
+#endif
+    }
+
+    void MappedFile::Advise(size_t offset, size_t length, FileAccessHint hint) const
+    {
+        if (!data || offset >= size) {
+            return;
+        }
+
+        length = std::min(length, size - offset);
+
+        size_t page_size = GetPageSize();
+        size_t begin = offset / page_size * page_size;
+        size_t end = offset + length;
+
+#ifdef _WIN32
+        if (hint == FileAccessHint::WillNeed) {
+            WIN32_MEMORY_RANGE_ENTRY range { data + begin, end - begin };
+            PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+        } else if (hint == FileAccessHint::DontNeed) {
+
+            // Unlocking pages that are not locked removes them from the working set
+
+            VirtualUnlock(data + begin, end - begin);
+        }
+#else
+        int advice = MADV_NORMAL;
+        switch (hint) {
+            break;case FileAccessHint::Sequential: advice = MADV_SEQUENTIAL;
+            break;case FileAccessHint::Random:     advice = MADV_RANDOM;
+            break;case FileAccessHint::WillNeed:   advice = MADV_WILLNEED;
+            break;case FileAccessHint::DontNeed:   advice = MADV_DONTNEED;
+        }
+        madvise(data + begin, end - begin, advice);
+#endif
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "imp_Core.hpp"
+
+#include <filesystem>
+
+namespace imp
+{
+    enum class FileAccessHint
+    {
+        Sequential,
+        Random,
+        WillNeed,
+
+        // Drop resident pages, they are faulted back in from the file on next access
+
+        DontNeed,
+    };
+
+    // Read-only, copy-on-write view of a whole file. Pages are served directly from
+    //  the page cache and are only faulted in on access.
+
+    struct MappedFile
+    {
+        std::byte* data = nullptr;
+        size_t     size = 0;
+
+        // Number of readable zero bytes guaranteed after the end of the file data
+
+        size_t padding = 0;
+
+        void*  mapping = nullptr;
+        size_t mapping_size = 0;
+        void*  file_handle = nullptr;
+        void*  mapping_handle = nullptr;
+
+    public:
+        MappedFile() = default;
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        ~MappedFile();
+
+        // Returns nullptr if the file could not be mapped, or if min_padding zero bytes (for
+        //  parsers that over-read) could not be reserved after the file data.
+
+        static std::unique_ptr<MappedFile> Open(const std::filesystem::path& path, size_t min_padding = 0);
+
+        void Advise(size_t offset, size_t length, FileAccessHint hint) const;
+    };
+}
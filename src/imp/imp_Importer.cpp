@@ -1,7 +1,16 @@
 #include "imp_Importer.hpp"
 
 #include "process/imp_ProcessGeometry.hpp"
+#include "process/imp_DeduplicateVertices.hpp"
+#include "process/imp_OptimizeVertexCache.hpp"
+#include "process/imp_GenerateLods.hpp"
+#include "process/imp_Meshletize.hpp"
+#include "process/imp_BuildClusterLods.hpp"
+#include "process/imp_QuantizePositions.hpp"
+#include "process/imp_CompactIndices.hpp"
 #include "process/imp_ProcessMaterials.hpp"
+#include "process/imp_DeduplicateTextures.hpp"
+#include "process/imp_StreamGeometry.hpp"
 
 namespace imp
 {
@@ -104,14 +113,51 @@ namespace imp
         }
     }
 
-    Scene Importer::GenerateScene()
+    // Runs all enabled geometry stages, writing pages and ranges for the input geometries to scene
+
+    static void GenerateGeometry(Importer& importer, Scene& scene, std::span<const InGeometry> input)
     {
-        Scene scene;
+        auto& settings = importer.settings;
 
-        detail::ProcessGeometry(*this, scene);
-        detail::ProcessMaterials(*this, scene);
+        detail::ProcessGeometry(importer, scene, input);
+        if (settings.deduplicate_vertices) {
+            detail::DeduplicateVertices(importer, scene);
+        }
+        if (settings.optimize_vertex_cache) {
+            detail::OptimizeVertexCache(importer, scene);
+        }
+        if (settings.lod_count) {
+            detail::GenerateLods(importer, scene);
+        }
+        if (settings.generate_meshlets) {
+            detail::Meshletize(importer, scene);
+        }
+        if (settings.generate_cluster_lods) {
+            detail::BuildClusterLods(importer, scene);
+        }
+        if (settings.quantize_positions) {
+            detail::QuantizePositions(importer, scene);
+        }
+        if (settings.compact_indices) {
+            detail::CompactIndices(importer, scene);
+        }
+    }
 
-        scene.meshes = { memory_pool.Allocate<Mesh>(meshes.size()), meshes.size() };
+    // Runs all enabled material and texture stages
+
+    static void GenerateMaterials(Importer& importer, Scene& scene)
+    {
+        detail::ProcessMaterials(importer, scene);
+        if (importer.settings.deduplicate_textures) {
+            detail::DeduplicateTextures(importer, scene);
+        }
+    }
+
+    static void GenerateMeshes(Importer& importer, Scene& scene)
+    {
+        auto& meshes = importer.meshes;
+
+        scene.meshes = { importer.memory_pool.Allocate<Mesh>(meshes.size()), meshes.size() };
 
         for (uint32_t i = 0; i < meshes.size(); ++i) {
             scene.meshes[i] = Mesh {
@@ -119,6 +165,74 @@ namespace imp
                 .transform = meshes[i].transform,
             };
         }
+    }
+
+    Scene Importer::GenerateScene()
+    {
+        Scene scene;
+
+        // Geometry deferred for streaming is loaded in full
+
+        if (settings.stream_memory_budget && loader) {
+            loader->LoadGeometries(*this, 0, uint32_t(geometries.size()));
+        }
+
+        GenerateGeometry(*this, scene, geometries);
+        GenerateMaterials(*this, scene);
+        GenerateMeshes(*this, scene);
+
+        return scene;
+    }
+
+    Scene Importer::StreamScene(GeometrySink& sink)
+    {
+        if (!settings.stream_memory_budget) {
+            Error("Streaming requires a stream memory budget, set before loading");
+        }
+
+        Scene scene;
+
+        using namespace std::chrono;
+        auto start = steady_clock::now();
+
+        auto batches = detail::PlanGeometryBatches(*this);
+
+        uint32_t first_geometry = 0;
+        uint64_t max_working_set = 0;
+
+        for (auto& batch : batches) {
+
+            // Batch output is allocated from the importer pool and rewound after the sink has
+            //  consumed it, so retained chunks only grow to the largest batch
+
+            MemoryScope scope(memory_pool);
+
+            loader->LoadGeometries(*this, batch.first, batch.count);
+
+            Scene batch_scene;
+            GenerateGeometry(*this, batch_scene, std::span(geometries).subspan(batch.first, batch.count));
+
+            sink.WriteGeometryBatch(GeometryBatch {
+                .first_geometry = first_geometry,
+                .first_range = batch.first,
+                .geometries = batch_scene.geometries,
+                .geometry_ranges = batch_scene.geometry_ranges,
+            });
+            first_geometry += uint32_t(batch_scene.geometries.count);
+
+            loader->ReleaseGeometries(*this, batch.first, batch.count);
+
+            max_working_set = std::max(max_working_set, batch.working_set);
+        }
+
+        auto end = steady_clock::now();
+
+        fmt::println("Streamed {} geometries in {} batches ({} pages), max estimated working set {} bytes, in {} ms",
+            geometries.size(), batches.size(), first_geometry, max_working_set,
+            duration_cast<milliseconds>(end - start).count());
+
+        GenerateMaterials(*this, scene);
+        GenerateMeshes(*this, scene);
 
         return scene;
     }
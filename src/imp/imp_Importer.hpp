@@ -3,6 +3,8 @@
 #include "imp_Core.hpp"
 #include "imp_Scene.hpp"
 
+#include "process/imp_ImageProcess.hpp"
+
 #include <filesystem>
 #include <variant>
 
@@ -17,6 +19,14 @@ namespace imp
         struct ModelLoader
         {
             virtual bool Import(Importer& importer, const std::filesystem::path& path) = 0;
+
+            // When streaming, Import only records geometry sizes (ranges with null data). Data for
+            //  a batch of geometries is loaded on request and released again after processing.
+            //  Loaders that always load eagerly can ignore these.
+
+            virtual void LoadGeometries(Importer& importer, uint32_t first, uint32_t count) {}
+            virtual void ReleaseGeometries(Importer& importer, uint32_t first, uint32_t count) {}
+
             virtual ~ModelLoader() = 0;
         };
 
@@ -27,12 +37,17 @@ namespace imp
         std::monostate RegisterModelLoader(ModelLoaderFn fn);
     };
 
+    // Input ranges may reference memory owned by the loader (e.g. loaded file buffers),
+    //  which remains valid for the lifetime of the Importer
+
+    // Read-only input, may reference memory owned by the loader (e.g. mapped asset buffers)
+
     struct InGeometry
     {
-        Range<glm::vec3> positions;
-        Range<glm::vec3> normals;
-        Range<glm::vec2> tex_coords;
-        Range<uint32_t>  indices;
+        Range<const glm::vec3> positions;
+        Range<const glm::vec3> normals;
+        Range<const glm::vec2> tex_coords;
+        Range<const uint32_t>  indices;
     };
 
     struct InMesh
@@ -46,9 +61,11 @@ namespace imp
         std::string uri;
     };
 
+    // Encoded image file contents, may reference memory owned by the loader
+
     struct InImageFileBuffer
     {
-        std::vector<std::byte> data;
+        Range<const std::byte> data;
     };
 
     struct InImageBuffer
@@ -67,30 +84,201 @@ namespace imp
 
     struct InMaterial
     {
-        // struct Property
-        // {
-        //     std::string_view      name;
-        //     int32_t               texture_idx = -1;
-        //     std::array<float, 4>  values = {};
-        // };
+        enum class ChannelConversion : uint8_t
+        {
+            None,
+            SrgbToLinear,
+            LinearToSrgb,
+        };
 
-        // std::vector<Property> properties;
+        // Output channel = conversion(invert(input * scale + bias)), with the input channel read
+        //  from one of the process sources (normalized to [0, 1]) or a constant value. Results
+        //  are clamped and rounded to the output format.
+
+        struct ChannelOp
+        {
+            static constexpr int8_t Constant = -1;
+
+            int8_t            input = 0;
+            uint8_t           channel = 0;
+            float             value = 0.f;
+            float             scale = 1.f;
+            float             bias = 0.f;
+            bool              invert = false;
+            ChannelConversion conversion = ChannelConversion::None;
+        };
+
+        // Each output channel is described by a channel op indexing into sources, which by default
+        //  copy the matching channels of the first source. All sources must be the same size.
 
         struct TextureProcess
         {
-            int32_t       source = -1;
-            TextureFormat format;
+            std::array<int32_t, 4> sources = { -1, -1, -1, -1 };
+            TextureFormat          format;
+
+            std::array<ChannelOp, 4> channels = {
+                ChannelOp { .channel = 0 },
+                ChannelOp { .channel = 1 },
+                ChannelOp { .channel = 2 },
+                ChannelOp { .channel = 3 },
+            };
+
+            // Treat channels 0-2 as a tangent space normal in [0, 1], renormalized after the channel
+            //  ops before writing. Two channel formats store XY, Z is reconstructed when sampled.
+
+            bool normal_xy = false;
+
+            // Largest output dimension, halving from the source size until it fits. 0 for no limit
+            //  beyond ProcessSettings::max_texture_size.
+
+            uint32_t max_size = 0;
+
+            // Slow fallback for arbitrary processing, called per pixel on the channel op results
 
             std::function<glm::vec4(glm::vec4)> fn;
         };
 
         TextureProcess basecolor_alpha;
+
+        // Single channel processes, packed together as RG8 unless split_metalness_roughness is set
+
+        TextureProcess metalness;
+        TextureProcess roughness;
+
+        TextureProcess normal;
+        TextureProcess emission;
+        TextureProcess transmission;
+
+        // Constant factors, multiplied with the textures when sampled
+
+        glm::vec4 albedo_alpha_factor = glm::vec4(1.f);
+        float     metalness_factor = 1.f;
+        float     roughness_factor = 1.f;
+        glm::vec3 emission_factor = glm::vec3(0.f);
+        float     transmission_factor = 0.f;
+    };
+
+    struct ProcessSettings
+    {
+        // Stream geometry through the pipeline in batches whose estimated working set (input,
+        //  output and processing scratch) stays within this many bytes, see Importer::StreamScene.
+        //  Must be set before LoadFile. A geometry larger than the budget forms its own batch.
+
+        uint64_t stream_memory_budget = 0;
+
+        // Texture sources are decoded lazily, only if referenced by a material process. Sources
+        //  are decoded in waves whose decoded size and processing scratch stays within this many
+        //  bytes, 0 for no limit. A single source larger than the budget is decoded alone.
+
+        uint64_t texture_memory_budget = 0;
+
+        // Identify texture sources by a hash of their file or buffer contents so duplicates are
+        //  decoded once, and merge textures with identical processed output
+
+        bool deduplicate_textures = true;
+
+        // Write metalness and roughness to separate R8 textures instead of one RG8 texture
+
+        bool split_metalness_roughness = false;
+
+        // Halve textures until their largest dimension is at most max_texture_size (0 for no limit),
+        //  then halve the largest textures until all texture data fits texture_vram_budget bytes
+        //  (0 for no limit). Sources are downscaled with texture_resize_filter right after decode.
+
+        uint32_t    max_texture_size = 0;
+        uint64_t    texture_vram_budget = 0;
+        ImageFilter texture_resize_filter = ImageFilter::Kaiser;
+
+        // Generate full mip chains for textures, filtered in linear space for sRGB formats
+
+        bool        generate_texture_mips = false;
+        ImageFilter texture_mip_filter = ImageFilter::Box;
+
+        // Block compress textures, RGBA8 to BC7, RG8 to BC5, R8 to BC4 and RGBA16 float to unsigned
+        //  BC6H. Processes may also request block compressed formats directly.
+
+        bool                      compress_textures = false;
+        TextureCompressionQuality texture_compression_quality = TextureCompressionQuality::Normal;
+
+        // Split geometry output into pages of at most this many bytes of vertex and index data,
+        //  0 only splits where 32 bit offsets would overflow. Ranges larger than the budget get
+        //  their own page.
+
+        uint64_t geometry_page_bytes = 0;
+
+        // Merge vertices that are identical after quantization
+
+        bool deduplicate_vertices = true;
+
+        // Reorder triangles for post-transform vertex cache reuse, then vertices for fetch locality
+
+        bool     optimize_vertex_cache = false;
+        uint32_t vertex_cache_size = 16;
+
+        // Generate up to lod_count reduced index sets per range, each level targeting
+        //  lod_triangle_ratio times the triangles of the previous one
+
+        uint32_t lod_count = 0;
+        float    lod_triangle_ratio = 0.5f;
+
+        // Partition geometry into meshlets with culling bounds. Max vertices must be <= 256.
+
+        bool     generate_meshlets = false;
+        uint32_t meshlet_max_vertices = 64;
+        uint32_t meshlet_max_triangles = 124;
+
+        // Build a cluster LOD hierarchy from groups of cluster_group_size meshlets, using
+        //  the meshlet limits above
+
+        bool     generate_cluster_lods = false;
+        uint32_t cluster_group_size = 4;
+
+        // Store tex coords normalized over the bounds of each range, using UNorm8 where the
+        //  max error in UV units is within budget and UNorm16 otherwise
+
+        bool  quantize_tex_coords = false;
+        float tex_coord_max_error = 1.f / 8192.f;
+
+        // Write 8 / 16 / 32 bit index data chosen per range from its max vertex in place of the
+        //  32 bit indices. 8 bit indices are opt in as not all APIs support them.
+
+        bool compact_indices = false;
+        bool allow_uint8_indices = false;
+
+        // Quantize positions to 16 bit offsets on a global grid, so that shared edges between
+        //  ranges and meshlets remain watertight. A power of two step keeps the grid exact.
+
+        bool  quantize_positions = false;
+        float position_grid_step = 1.f / 1024.f;
+    };
+
+    // Geometry output for one streamed batch. Ranges and pages are numbered locally, the
+    //  first_* offsets give their global indices. Data is only valid during WriteGeometryBatch.
+
+    struct GeometryBatch
+    {
+        uint32_t first_geometry;
+        uint32_t first_range;
+
+        Range<Geometry>      geometries;
+        Range<GeometryRange> geometry_ranges;
     };
 
+    struct GeometrySink
+    {
+        virtual void WriteGeometryBatch(const GeometryBatch& batch) = 0;
+        virtual ~GeometrySink() = 0;
+    };
+
+    inline
+    GeometrySink::~GeometrySink() = default;
+
     struct Importer
     {
         std::filesystem::path base_dir;
 
+        ProcessSettings settings;
+
         std::unique_ptr<loaders::ModelLoader> loader;
 
         std::vector<InGeometry> geometries;
@@ -99,6 +287,8 @@ namespace imp
         std::vector<InTexture>  textures;
         std::vector<InMaterial> materials;
 
+        // Backing storage for all generated Scene ranges
+
         MemoryPool memory_pool;
 
     public:
@@ -109,5 +299,10 @@ namespace imp
         void ReportDetailed();
 
         Scene GenerateScene();
+
+        // Processes geometry batch by batch into the sink, releasing each batch's input and
+        //  output before loading the next. The returned scene holds materials and meshes only.
+
+        Scene StreamScene(GeometrySink& sink);
     };
 }
\ No newline at end of file
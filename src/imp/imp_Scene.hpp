@@ -27,21 +27,179 @@ namespace imp
     template<class T>
     using Vec4 = std::array<T, 4>;
 
+    struct Meshlet
+    {
+        uint32_t vertex_offset;
+        uint32_t triangle_offset;
+        uint32_t vertex_count;
+        uint32_t triangle_count;
+    };
+
+    struct MeshletBounds
+    {
+        glm::vec3 center;
+        float     radius;
+
+        // Backface cone, the meshlet can be culled from view position P if
+        //  dot(normalize(cone_apex - P), cone_axis) >= cone_cutoff
+
+        glm::vec3 cone_apex;
+        glm::vec3 cone_axis;
+        float     cone_cutoff;
+    };
+
+    // Reduced detail index set sharing the vertices of its geometry range. Error is the
+    //  approximate object space deviation from full detail, project it by distance at
+    //  runtime to select levels by screen-space error.
+
+    struct GeometryLod
+    {
+        uint32_t first_index;
+        uint32_t triangle_count;
+        float    error;
+    };
+
+    // Node in a cluster LOD hierarchy. A cluster is drawn when its own error projected from
+    //  (center, radius) is acceptable and its parent error projected from (parent_center,
+    //  parent_radius) is not. Root clusters have parent_error = FLT_MAX.
+
+    struct ClusterLod
+    {
+        glm::vec3 center;
+        float     radius;
+        float     error;
+        glm::vec3 parent_center;
+        float     parent_radius;
+        float     parent_error;
+        uint32_t  level;
+    };
+
+    // A page of geometry data. Ranges reference their page through geometry_idx, all
+    //  ranges in a page are contiguous in Scene::geometry_ranges.
+
     struct Geometry
     {
+        uint32_t             first_range;
+        uint32_t             range_count;
+
         Range<uint32_t>      indices;
         Range<glm::vec3>     positions;
         Range<Basis>         tangent_spaces;
-        Range<Vec2<Float16>> tex_coords;
+
+        // Packed per range at the width of GeometryRange::tex_coord_format, starting at
+        //  GeometryRange::tex_coord_byte_offset
+
+        Range<std::byte>     tex_coords;
+
+        // Positions quantized to a global grid,
+        //  position = (position_grid_origin + origin + offset) * position_grid_step.
+        //  Offsets are stored per meshlet / cluster vertex when those are generated, otherwise
+        //  per vertex relative to the owning range's position_origin.
+
+        float                 position_grid_step = 0.f;
+        Vec3<int64_t>         position_grid_origin = {};
+
+        // Offsets are packed per range at the width of GeometryRange::position_format.
+        //  Vertex v of a range starts at position_byte_offset + v * position size, vertex v of
+        //  meshlet j at meshlet_position_byte_offset + (meshlets[j].vertex_offset
+        //  - meshlets[first_meshlet].vertex_offset + v) * position size, clusters likewise.
+
+        Range<std::byte>      quantized_positions;
+        Range<std::byte>      meshlet_positions;
+        Range<Vec3<int32_t>>  meshlet_position_origins;
+        Range<std::byte>      cluster_positions;
+        Range<Vec3<int32_t>>  cluster_position_origins;
+
+        // Meshlet vertices index relative to the owning range's vertex_offset,
+        //  meshlet triangles index into the meshlet's vertices
+
+        Range<Meshlet>       meshlets;
+        Range<MeshletBounds> meshlet_bounds;
+        Range<uint32_t>      meshlet_vertices;
+        Range<Vec3<uint8_t>> meshlet_triangles;
+
+        // LOD indices are relative to the owning range's vertex_offset, LODs are ordered
+        //  from most to least detailed
+
+        Range<GeometryLod>   lods;
+        Range<uint32_t>      lod_indices;
+
+        // Indices narrowed to the smallest width per range, see GeometryRange::index_format.
+        //  When written these replace indices and lod_indices, which are left empty.
+
+        Range<std::byte>     compact_indices;
+        Range<std::byte>     compact_lod_indices;
+
+        // Cluster LOD hierarchy, clusters use the meshlet layout and are range relative
+
+        Range<Meshlet>       clusters;
+        Range<MeshletBounds> cluster_bounds;
+        Range<ClusterLod>    cluster_lods;
+        Range<uint32_t>      cluster_vertices;
+        Range<Vec3<uint8_t>> cluster_triangles;
+    };
+
+    enum class TexCoordFormat
+    {
+        Float16,
+        UNorm16,
+        UNorm8,
+    };
+
+    enum class PositionFormat
+    {
+        UInt16,
+
+        // Ranges with a vertex, meshlet or cluster spanning more than 16 bits of grid steps
+
+        UInt32,
+    };
+
+    enum class IndexFormat
+    {
+        UInt8,
+        UInt16,
+        UInt32,
     };
 
     struct GeometryRange
     {
         uint32_t geometry_idx;
+
+        // Offsets are relative to the geometry page
+
         uint32_t vertex_offset;
         uint32_t max_vertex;
         uint32_t first_index;
         uint32_t triangle_count;
+        uint32_t first_meshlet = 0;
+        uint32_t meshlet_count = 0;
+        uint32_t first_lod = 0;
+        uint32_t lod_count = 0;
+        uint32_t first_cluster = 0;
+        uint32_t cluster_count = 0;
+
+        Vec3<int32_t>  position_origin = {};
+        PositionFormat position_format = PositionFormat::UInt16;
+        uint64_t       position_byte_offset = 0;
+        uint64_t       meshlet_position_byte_offset = 0;
+        uint64_t       cluster_position_byte_offset = 0;
+
+        // Normalized tex coords decode as tex_coord_offset + value * tex_coord_scale, with an
+        //  absolute error of at most tex_coord_max_error
+
+        TexCoordFormat tex_coord_format = TexCoordFormat::Float16;
+        glm::vec2      tex_coord_scale = { 1.f, 1.f };
+        glm::vec2      tex_coord_offset = {};
+        float          tex_coord_max_error = 0.f;
+        uint64_t       tex_coord_byte_offset = 0;
+
+        // Location of this range's indices and LOD indices in the compact index data.
+        //  LOD j starts at lod_index_byte_offset + (lods[j].first_index - lods[first_lod].first_index) * index size.
+
+        IndexFormat index_format = IndexFormat::UInt32;
+        uint64_t    index_byte_offset = 0;
+        uint64_t    lod_index_byte_offset = 0;
     };
 
     enum class TextureFormat
@@ -50,12 +208,32 @@ namespace imp
         RGBA8_UNORM,
         RG8_UNORM,
         R8_UNORM,
+
+        // Half float, linear HDR data
+
+        RGBA16_SFLOAT,
+
+        // 4x4 block compressed
+
+        BC7_SRGB,
+        BC7_UNORM,
+        BC5_UNORM,
+        BC4_UNORM,
+        BC6H_UFLOAT,
+        BC6H_SFLOAT,
     };
 
+    // Mip levels are packed in data largest first, each level starting at its mip offset. Levels
+    //  are stored as rows of blocks, edge blocks of block compressed levels are padded.
+
     struct Texture
     {
         glm::uvec2       size;
         TextureFormat    format;
+        glm::uvec2       block_extent = { 1, 1 };
+        uint32_t         block_bytes = 0;
+        uint32_t         mip_count = 1;
+        Range<uint64_t>  mip_offsets;
         Range<std::byte> data;
     };
 
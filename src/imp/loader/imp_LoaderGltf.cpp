@@ -1,4 +1,5 @@
 #include <imp/imp_Importer.hpp>
+#include <imp/imp_FileMapping.hpp>
 
 #include <fastgltf/parser.hpp>
 #include <fastgltf/util.hpp>
@@ -14,16 +15,163 @@ namespace imp::loaders
         MemoryPool memory_pool;
 
     public:
+        // Input files are memory mapped, buffer sources reference the mappings directly.
+        //  All must outlive the asset.
+
+        fastgltf::GltfDataBuffer                 data;
+        std::unique_ptr<MappedFile>              file_mapping;
+        std::vector<std::unique_ptr<MappedFile>> buffer_mappings;
+
+        void MapExternalBuffers()
+        {
+            for (auto& buffer : asset.buffers) {
+                auto* uri = std::get_if<fastgltf::sources::URI>(&buffer.data);
+                if (!uri) {
+                    continue;
+                }
+
+                auto buffer_path = importer->base_dir / std::filesystem::path(uri->uri.path());
+                auto mapping = MappedFile::Open(buffer_path);
+                if (!mapping || uri->fileByteOffset + buffer.byteLength > mapping->size) {
+                    Error("fastgltf-loader: Could not map buffer [{}]", buffer_path.string());
+                }
+
+                fastgltf::sources::ByteView view;
+                view.bytes = fastgltf::span<const std::byte>(mapping->data + uri->fileByteOffset, buffer.byteLength);
+                view.mimeType = fastgltf::MimeType::GltfBuffer;
+                buffer.data = view;
+
+                buffer_mappings.emplace_back(std::move(mapping));
+            }
+        }
+
+        // Accessors are read roughly in order, hint the kernel to read ahead the regions
+        //  backing geometry and to drop pages behind the reads
+
+        void AdviseRange(const std::byte* begin, size_t length, FileAccessHint hint)
+        {
+            auto try_mapping = [&](const MappedFile* mapping) {
+                if (mapping && begin >= mapping->data && begin < mapping->data + mapping->size) {
+                    mapping->Advise(size_t(begin - mapping->data), length, hint);
+                }
+            };
+            try_mapping(file_mapping.get());
+            for (auto& mapping : buffer_mappings) {
+                try_mapping(mapping.get());
+            }
+        }
+
+        void AdviseAccessor(const fastgltf::Accessor* accessor, FileAccessHint hint)
+        {
+            if (!accessor || !accessor->bufferViewIndex) {
+                return;
+            }
+            auto& view = asset.bufferViews[accessor->bufferViewIndex.value()];
+            if (auto* bytes = fastgltf::DefaultBufferDataAdapter{}(asset.buffers[view.bufferIndex])) {
+                AdviseRange(bytes + view.byteOffset, view.byteLength, hint);
+            }
+        }
+
+        void AdviseBufferReads()
+        {
+            for (auto& buffer : asset.buffers) {
+                if (auto* bytes = fastgltf::DefaultBufferDataAdapter{}(buffer)) {
+                    AdviseRange(bytes, buffer.byteLength, FileAccessHint::Sequential);
+                }
+            }
+        }
+
+    public:
+        uint32_t accessors_in_place = 0;
+        uint32_t accessors_converted = 0;
+
+        // Returns a pointer to the accessor data if it is already laid out exactly as
+        //  an array of T in a loaded buffer, otherwise nullptr
+
+        template<class T>
+        const T* FindTightlyPackedAccessorData(const fastgltf::Accessor& accessor)
+        {
+            fastgltf::AccessorType type;
+            fastgltf::ComponentType component_type;
+            if constexpr (std::is_same_v<T, glm::vec3>) {
+                type = fastgltf::AccessorType::Vec3;
+                component_type = fastgltf::ComponentType::Float;
+            } else if constexpr (std::is_same_v<T, glm::vec2>) {
+                type = fastgltf::AccessorType::Vec2;
+                component_type = fastgltf::ComponentType::Float;
+            } else if constexpr (std::is_same_v<T, uint32_t>) {
+                type = fastgltf::AccessorType::Scalar;
+                component_type = fastgltf::ComponentType::UnsignedInt;
+            } else {
+                return nullptr;
+            }
+
+            if (accessor.type != type
+                    || accessor.componentType != component_type
+                    || accessor.normalized
+                    || accessor.sparse
+                    || !accessor.bufferViewIndex) {
+                return nullptr;
+            }
+
+            auto& view = asset.bufferViews[accessor.bufferViewIndex.value()];
+            if (view.byteStride.value_or(sizeof(T)) != sizeof(T)) {
+                return nullptr;
+            }
+
+            if (accessor.byteOffset + accessor.count * sizeof(T) > view.byteLength) {
+                return nullptr;
+            }
+
+            auto* bytes = fastgltf::DefaultBufferDataAdapter{}(asset.buffers[view.bufferIndex]);
+            if (!bytes) {
+                return nullptr;
+            }
+
+            bytes += view.byteOffset + accessor.byteOffset;
+            if (reinterpret_cast<uintptr_t>(bytes) % alignof(T)) {
+                return nullptr;
+            }
+
+            return reinterpret_cast<const T*>(bytes);
+        }
+
+        // Ranges for tightly packed accessors reference the asset buffers directly, these
+        //  are owned by the loader and live as long as the importer. Only accessors that
+        //  need conversion (narrower types, normalized, sparse, strided) are copied.
+
         template<class T>
-        Range<T> MakeRangeForAccessor(const fastgltf::Accessor& accessor)
+        Range<const T> MakeRangeForAccessor(const fastgltf::Accessor& accessor)
         {
+            if (auto* data = FindTightlyPackedAccessorData<T>(accessor)) {
+                accessors_in_place++;
+                return Range<const T> { data, accessor.count };
+            }
+
+            accessors_converted++;
             auto* arr = memory_pool.Allocate<T>(accessor.count);
             fastgltf::copyFromAccessor<T>(asset, accessor, arr);
-            return Range<T> { arr, accessor.count };
+            return Range<const T> { arr, accessor.count };
         }
 
     public:
+        struct GeometrySource
+        {
+            const fastgltf::Accessor* positions = nullptr;
+            const fastgltf::Accessor* normals = nullptr;
+            const fastgltf::Accessor* tex_coords = nullptr;
+            const fastgltf::Accessor* indices = nullptr;
+        };
+
         ankerl::unordered_dense::map<std::pair<uint32_t, uint32_t>, uint32_t> geometries;
+        std::vector<GeometrySource> geometry_sources;
+
+        // Converted accessor data for the current streamed batch is allocated after this
+
+        MemoryPool::Marker batch_marker;
+
+        // Records the accessors for each geometry, with sized but empty ranges. Data is loaded
+        //  for all geometries up front unless streaming.
 
         void LoadGeometry()
         {
@@ -39,30 +187,88 @@ namespace imp::loaders
                         continue;
                     }
 
-                    InGeometry geom;
-
-                    geom.positions = MakeRangeForAccessor<glm::vec3>(*pos_accessor);
-
+                    GeometrySource source;
+                    source.positions = pos_accessor;
+                    source.normals = findAccessor("NORMAL");
+                    source.tex_coords = findAccessor("TEXCOORD_0");
                     if (prim.indicesAccessor) {
-                        geom.indices = MakeRangeForAccessor<uint32_t>(asset.accessors[prim.indicesAccessor.value()]);
+                        source.indices = &asset.accessors[prim.indicesAccessor.value()];
                     }
 
-                    if (auto* normal_accessor = findAccessor("NORMAL")) {
-                        geom.normals = MakeRangeForAccessor<glm::vec3>(*normal_accessor);
-                    }
+                    auto count = [](const fastgltf::Accessor* accessor) -> size_t {
+                        return accessor ? accessor->count : 0;
+                    };
 
-                    if (auto* texcoord_accessor = findAccessor("TEXCOORD_0")) {
-                        geom.tex_coords = MakeRangeForAccessor<glm::vec2>(*texcoord_accessor);
-                    }
+                    InGeometry geom;
+                    geom.positions.count = count(source.positions);
+                    geom.normals.count = count(source.normals);
+                    geom.tex_coords.count = count(source.tex_coords);
+                    geom.indices.count = count(source.indices);
 
                     uint32_t geom_idx = uint32_t(importer->geometries.size());
                     importer->geometries.emplace_back(geom);
+                    geometry_sources.emplace_back(source);
                     geometries.insert({
                         { uint32_t(&mesh - asset.meshes.data()), uint32_t(&prim - mesh.primitives.data()) },
                         geom_idx,
                     });
                 }
             }
+
+            if (!importer->settings.stream_memory_budget) {
+                LoadGeometries(*importer, 0, uint32_t(importer->geometries.size()));
+            }
+        }
+
+        virtual void LoadGeometries(Importer& _importer, uint32_t first, uint32_t count) override
+        {
+            batch_marker = memory_pool.GetMarker();
+
+            for (uint32_t i = first; i < first + count; ++i) {
+                auto& source = geometry_sources[i];
+                AdviseAccessor(source.positions, FileAccessHint::WillNeed);
+                AdviseAccessor(source.normals, FileAccessHint::WillNeed);
+                AdviseAccessor(source.tex_coords, FileAccessHint::WillNeed);
+                AdviseAccessor(source.indices, FileAccessHint::WillNeed);
+            }
+
+            for (uint32_t i = first; i < first + count; ++i) {
+                auto& source = geometry_sources[i];
+                auto& geom = _importer.geometries[i];
+
+                geom.positions = MakeRangeForAccessor<glm::vec3>(*source.positions);
+                if (source.normals) {
+                    geom.normals = MakeRangeForAccessor<glm::vec3>(*source.normals);
+                }
+                if (source.tex_coords) {
+                    geom.tex_coords = MakeRangeForAccessor<glm::vec2>(*source.tex_coords);
+                }
+                if (source.indices) {
+                    geom.indices = MakeRangeForAccessor<uint32_t>(*source.indices);
+                }
+            }
+        }
+
+        // Drops converted data and the resident file pages behind in place ranges. Regions
+        //  shared with later geometries are faulted back in from the file if needed.
+
+        virtual void ReleaseGeometries(Importer& _importer, uint32_t first, uint32_t count) override
+        {
+            for (uint32_t i = first; i < first + count; ++i) {
+                auto& source = geometry_sources[i];
+                AdviseAccessor(source.positions, FileAccessHint::DontNeed);
+                AdviseAccessor(source.normals, FileAccessHint::DontNeed);
+                AdviseAccessor(source.tex_coords, FileAccessHint::DontNeed);
+                AdviseAccessor(source.indices, FileAccessHint::DontNeed);
+
+                auto& geom = _importer.geometries[i];
+                geom.positions.begin = nullptr;
+                geom.normals.begin = nullptr;
+                geom.tex_coords.begin = nullptr;
+                geom.indices.begin = nullptr;
+            }
+
+            memory_pool.Rewind(batch_marker);
         }
 
     public:
@@ -82,25 +288,16 @@ namespace imp::loaders
                             add_image(InImageFileURI(fmt::format("{}/{}", importer->base_dir.string(), uri.uri.path())));
                         },
                         [&](const fastgltf::sources::Vector& vec) {
-                            InImageFileBuffer source;
-                            source.data.resize(vec.bytes.size());
-                            std::memcpy(source.data.data(), vec.bytes.data(), vec.bytes.size());
-                            add_image(std::move(source));
+                            add_image(InImageFileBuffer({ reinterpret_cast<const std::byte*>(vec.bytes.data()), vec.bytes.size() }));
                         },
                         [&](const fastgltf::sources::ByteView& byteView) {
-                            InImageFileBuffer source;
-                            source.data.resize(byteView.bytes.size());
-                            std::memcpy(source.data.data(), byteView.bytes.data(), byteView.bytes.size());
-                            add_image(std::move(source));
+                            add_image(InImageFileBuffer({ byteView.bytes.data(), byteView.bytes.size() }));
                         },
                         [&](const fastgltf::sources::BufferView& bufferViewIdx) {
                             auto& view = asset.bufferViews[bufferViewIdx.bufferViewIndex];
                             auto& buffer = asset.buffers[view.bufferIndex];
                             auto* bytes = fastgltf::DefaultBufferDataAdapter{}(buffer) + view.byteOffset;
-                            InImageFileBuffer source;
-                            source.data.resize(view.byteLength);
-                            std::memcpy(source.data.data(), bytes, view.byteLength);
-                            add_image(std::move(source));
+                            add_image(InImageFileBuffer({ bytes, view.byteLength }));
                         },
                         [&](auto&&) {},
                     }, asset.images[texture_in.imageIndex.value()].data);
@@ -125,37 +322,76 @@ namespace imp::loaders
                     return out;
                 };
 
-                // auto& albedo_alpha = material.properties.emplace_back();
-                // albedo_alpha.name = "base_color";
-                // albedo_alpha.texture_idx = find_texture(material_in.pbrData.baseColorTexture);
-                // albedo_alpha.values = material_in.pbrData.baseColorFactor;
-
-                // auto& normal = material.properties.emplace_back();
-                // normal.name = "normal";
-                // normal.texture_idx = find_texture(material_in.normalTexture);
-
-                // auto& metalness_roughness = material.properties.emplace_back();
-                // metalness_roughness.name = "metalness_roughness";
-                // metalness_roughness.texture_idx = find_texture(material_in.pbrData.metallicRoughnessTexture);
-
-                // auto& metalness = material.properties.emplace_back();
-                // metalness.name = "metalness";
-                // metalness.values[0] = material_in.pbrData.metallicFactor;
+                material.basecolor_alpha = InMaterial::TextureProcess {
+                    .sources = { find_texture(material_in.pbrData.baseColorTexture), -1, -1, -1 },
+                    .format = TextureFormat::RGBA8_SRGB,
+                };
+                material.albedo_alpha_factor = std::bit_cast<glm::vec4>(set_values(material_in.pbrData.baseColorFactor));
 
-                // auto& roughness = material.properties.emplace_back();
-                // roughness.name = "roughness";
-                // roughness.values[0] = material_in.pbrData.roughnessFactor;
+                // Metalness is stored in blue, roughness in green
 
-                // auto& emission = material.properties.emplace_back();
-                // emission.name = "emission";
-                // emission.texture_idx = find_texture(material_in.emissiveTexture);
-                // emission.values = set_values(material_in.emissiveFactor);
-                // emission.values[3] = material_in.emissiveStrength.value_or(1.f);
+                int32_t metalness_roughness = find_texture(material_in.pbrData.metallicRoughnessTexture);
+                material.metalness = InMaterial::TextureProcess {
+                    .sources = { metalness_roughness, -1, -1, -1 },
+                    .format = TextureFormat::R8_UNORM,
+                    .channels = { InMaterial::ChannelOp { .channel = 2 } },
+                };
+                material.roughness = InMaterial::TextureProcess {
+                    .sources = { metalness_roughness, -1, -1, -1 },
+                    .format = TextureFormat::R8_UNORM,
+                    .channels = { InMaterial::ChannelOp { .channel = 1 } },
+                };
+                material.metalness_factor = material_in.pbrData.metallicFactor;
+                material.roughness_factor = material_in.pbrData.roughnessFactor;
+
+                // Normal scale applies to XY before renormalizing, (2v - 1) * s maps to v * s + (1 - s) / 2
+
+                if (material_in.normalTexture) {
+                    float scale = material_in.normalTexture->scale;
+                    float bias = 0.5f - 0.5f * scale;
+                    material.normal = InMaterial::TextureProcess {
+                        .sources = { find_texture(material_in.normalTexture), -1, -1, -1 },
+                        .format = TextureFormat::RG8_UNORM,
+                        .channels = {
+                            InMaterial::ChannelOp { .channel = 0, .scale = scale, .bias = bias },
+                            InMaterial::ChannelOp { .channel = 1, .scale = scale, .bias = bias },
+                            InMaterial::ChannelOp { .channel = 2 },
+                            InMaterial::ChannelOp { .channel = 3 },
+                        },
+                        .normal_xy = true,
+                    };
+                }
 
-                material.basecolor_alpha = InMaterial::TextureProcess {
-                    { find_texture(material_in.pbrData.baseColorTexture) }, TextureFormat::RGBA8_SRGB,
-                    [&](glm::vec4 v) -> glm::vec4 { return v; },
+                // Emission beyond the factor range is baked into an HDR texture, LDR files decoded
+                //  as float are linearized from sRGB
+
+                auto emissive_factor = set_values(material_in.emissiveFactor);
+                float emissive_strength = material_in.emissiveStrength.value_or(1.f);
+                material.emission = InMaterial::TextureProcess {
+                    .sources = { find_texture(material_in.emissiveTexture), -1, -1, -1 },
+                    .format = TextureFormat::RGBA8_SRGB,
+                    .channels = {
+                        InMaterial::ChannelOp { .channel = 0 },
+                        InMaterial::ChannelOp { .channel = 1 },
+                        InMaterial::ChannelOp { .channel = 2 },
+                        InMaterial::ChannelOp { .input = InMaterial::ChannelOp::Constant, .value = 1.f },
+                    },
                 };
+                if (emissive_strength > 1.f) {
+                    material.emission.format = TextureFormat::RGBA16_SFLOAT;
+                    for (uint32_t c = 0; c < 3; ++c) {
+                        material.emission.channels[c].scale = emissive_strength;
+                    }
+                }
+                material.emission_factor = glm::vec3(emissive_factor[0], emissive_factor[1], emissive_factor[2]);
+
+                if (material_in.transmission) {
+                    material.transmission = InMaterial::TextureProcess {
+                        .sources = { find_texture(material_in.transmission->transmissionTexture), -1, -1, -1 },
+                        .format = TextureFormat::R8_UNORM,
+                    };
+                    material.transmission_factor = material_in.transmission->transmissionFactor;
+                }
             }
         }
 
@@ -227,14 +463,26 @@ namespace imp::loaders
                 | fastgltf::Extensions::KHR_materials_unlit
             };
 
-            fastgltf::GltfDataBuffer data;
-            data.loadFromFile(path);
+            // Parse in place from a file mapping when enough zero padding can be reserved
+            //  after the file data, otherwise fall back to reading the file
+
+            file_mapping = MappedFile::Open(path, fastgltf::getGltfBufferPadding());
+            if (file_mapping) {
+                file_mapping->Advise(0, file_mapping->size, FileAccessHint::Sequential);
+            }
+
+            if (!file_mapping || !data.fromByteView(reinterpret_cast<uint8_t*>(file_mapping->data),
+                    file_mapping->size, file_mapping->size + file_mapping->padding)) {
+                file_mapping.reset();
+                data.loadFromFile(path);
+            }
+
+            // GLB and external buffers are not loaded by fastgltf. The GLB binary chunk is
+            //  referenced in the data buffer, and external buffers are mapped separately.
 
             constexpr auto GltfOptions =
                 fastgltf::Options::DontRequireValidAssetMember
-                | fastgltf::Options::AllowDouble
-                | fastgltf::Options::LoadGLBBuffers
-                | fastgltf::Options::LoadExternalBuffers;
+                | fastgltf::Options::AllowDouble;
 
             type = fastgltf::determineGltfFileType(&data);
 
@@ -252,9 +500,19 @@ namespace imp::loaders
 
             asset = std::move(res.get());
 
+            MapExternalBuffers();
+            AdviseBufferReads();
+
             LoadMaterials();
             LoadGeometry();
 
+            if (importer->settings.stream_memory_budget) {
+                fmt::println("fastgltf-loader: {} geometries deferred for streaming", geometry_sources.size());
+            } else {
+                fmt::println("fastgltf-loader: {} accessors referenced in place, {} converted",
+                    accessors_in_place, accessors_converted);
+            }
+
             for (auto& node_idx : asset.scenes[asset.defaultScene.value()].nodeIndices) {
                 LoadNode(asset.nodes[node_idx], glm::mat4(1.f));
             }
@@ -0,0 +1,495 @@
+#pragma once
+
+#include <imp/imp_Importer.hpp>
+
+#include "imp_Meshletize.hpp"
+#include "imp_GenerateLods.hpp"
+
+namespace imp::detail
+{
+    // Ranges at or above this size build each level's groups in parallel instead of
+    //  being built alongside other ranges
+
+    constexpr uint32_t ParallelClusterTriangleThreshold = 1 << 18;
+
+    // Stop simplifying groups that can not reach this fraction of their triangles
+
+    constexpr float ClusterSimplifyMinReduction = 0.85f;
+
+    constexpr uint32_t ClusterMaxLevels = 32;
+
+    inline
+    void MergeSpheres(glm::vec3& center, float& radius, glm::vec3 other_center, float other_radius)
+    {
+        auto offset = other_center - center;
+        float dist = glm::length(offset);
+
+        if (dist + other_radius <= radius) {
+            return;
+        }
+        if (dist + radius <= other_radius) {
+            center = other_center;
+            radius = other_radius;
+            return;
+        }
+
+        float new_radius = (dist + radius + other_radius) * 0.5f;
+        center += offset * ((new_radius - radius) / dist);
+        radius = new_radius;
+    }
+
+    // Cluster hierarchy for a single geometry range. Cluster offsets index into the vectors
+    //  here, cluster vertices are range relative.
+
+    struct ClusterLodSet
+    {
+        std::vector<Meshlet>       clusters;
+        std::vector<MeshletBounds> bounds;
+        std::vector<ClusterLod>    lods;
+        std::vector<uint32_t>      vertices;
+        std::vector<Vec3<uint8_t>> triangles;
+    };
+
+    // Builds a cluster DAG: the range is split into meshlets, adjacent clusters are grouped,
+    //  each group is merged and simplified to half its triangles with the group boundary
+    //  locked, then split into new clusters. This repeats on the new clusters until a single
+    //  cluster remains or no group can be simplified further.
+    //
+    // Group boundaries are open edges within the group, which the simplifier always locks,
+    //  so clusters from different levels meet without cracks. Group errors include the
+    //  errors of their children and group spheres enclose the child spheres, keeping the
+    //  projected error monotonic along any path in the DAG.
+
+    struct ClusterLodBuilder
+    {
+        static constexpr uint32_t Invalid = UINT32_MAX;
+
+        uint32_t max_vertices;
+        uint32_t max_triangles;
+        uint32_t group_size;
+
+        struct Group
+        {
+            std::vector<uint32_t> clusters;
+
+            bool       simplified;
+            float      error;
+            glm::vec3  center;
+            float      radius;
+            MeshletSet meshlets;
+        };
+
+        // Per worker scratch for simplifying groups
+
+        struct GroupScratch
+        {
+            MeshletBuilder         builder;
+            MeshSimplifier         simplifier;
+            std::vector<uint32_t>  local_index;
+            std::vector<uint32_t>  group_vertices;
+            std::vector<uint32_t>  indices;
+            std::vector<glm::vec3> positions;
+        };
+
+        std::vector<Group>      groups;
+        std::vector<uint32_t>   level_clusters;
+        std::vector<uint32_t>   next_clusters;
+        std::vector<uint32_t>   group_of;
+        std::vector<uint64_t>   vertex_clusters;
+        std::vector<uint64_t>   neighbours;
+        std::vector<uint32_t>   neighbour_offsets;
+        std::vector<uint32_t>   neighbour_weights;
+
+    public:
+        void Build(Range<uint32_t> indices, Range<glm::vec3> positions, ClusterLodSet& out, bool parallel)
+        {
+            out = {};
+
+            MeshletSet meshlets;
+            MeshletBuilder { .max_vertices = max_vertices, .max_triangles = max_triangles, .fill_nearest = false }.Build(indices, positions, meshlets);
+
+            level_clusters.clear();
+            for (uint32_t i = 0; i < meshlets.meshlets.size(); ++i) {
+                auto& bounds = meshlets.bounds[i];
+                level_clusters.push_back(AppendCluster(out, meshlets, i, bounds.center, bounds.radius, 0.f, 0));
+            }
+
+            for (uint32_t level = 1; level < ClusterMaxLevels && level_clusters.size() > 1; ++level) {
+                GroupClusters(out);
+
+#pragma omp parallel if(parallel)
+                {
+                    GroupScratch scratch {
+                        .builder { .max_vertices = max_vertices, .max_triangles = max_triangles, .fill_nearest = false },
+                    };
+                    scratch.local_index.assign(positions.count, Invalid);
+
+#pragma omp for schedule(dynamic)
+                    for (uint32_t g = 0; g < groups.size(); ++g) {
+                        SimplifyGroup(out, positions, groups[g], scratch);
+                    }
+                }
+
+                // Link children to their group and emit the new level
+
+                next_clusters.clear();
+                for (auto& group : groups) {
+                    if (!group.simplified) {
+                        continue;
+                    }
+
+                    for (uint32_t child : group.clusters) {
+                        auto& lod = out.lods[child];
+                        lod.parent_center = group.center;
+                        lod.parent_radius = group.radius;
+                        lod.parent_error = group.error;
+                    }
+
+                    for (uint32_t i = 0; i < group.meshlets.meshlets.size(); ++i) {
+                        next_clusters.push_back(AppendCluster(out, group.meshlets, i, group.center, group.radius, group.error, level));
+                    }
+                }
+
+                if (next_clusters.empty()) {
+                    break;
+                }
+                std::swap(level_clusters, next_clusters);
+            }
+        }
+
+    private:
+        uint32_t AppendCluster(ClusterLodSet& out, const MeshletSet& set, uint32_t idx, glm::vec3 center, float radius, float error, uint32_t level)
+        {
+            auto meshlet = set.meshlets[idx];
+
+            uint32_t cluster = uint32_t(out.clusters.size());
+            out.clusters.push_back(Meshlet {
+                .vertex_offset = uint32_t(out.vertices.size()),
+                .triangle_offset = uint32_t(out.triangles.size()),
+                .vertex_count = meshlet.vertex_count,
+                .triangle_count = meshlet.triangle_count,
+            });
+            out.bounds.push_back(set.bounds[idx]);
+            out.lods.push_back(ClusterLod {
+                .center = center,
+                .radius = radius,
+                .error = error,
+                .parent_center = center,
+                .parent_radius = radius,
+                .parent_error = FLT_MAX,
+                .level = level,
+            });
+
+            out.vertices.insert(out.vertices.end(),
+                set.vertices.begin() + meshlet.vertex_offset,
+                set.vertices.begin() + meshlet.vertex_offset + meshlet.vertex_count);
+            out.triangles.insert(out.triangles.end(),
+                set.triangles.begin() + meshlet.triangle_offset,
+                set.triangles.begin() + meshlet.triangle_offset + meshlet.triangle_count);
+
+            return cluster;
+        }
+
+        // Greedily groups clusters with the most shared vertices
+
+        void GroupClusters(const ClusterLodSet& out)
+        {
+            uint32_t cluster_count = uint32_t(level_clusters.size());
+
+            // Pairs of (vertex, level cluster) sorted by vertex give the clusters sharing each vertex
+
+            vertex_clusters.clear();
+            for (uint32_t c = 0; c < cluster_count; ++c) {
+                auto& cluster = out.clusters[level_clusters[c]];
+                for (uint32_t i = 0; i < cluster.vertex_count; ++i) {
+                    vertex_clusters.push_back((uint64_t(out.vertices[cluster.vertex_offset + i]) << 32) | c);
+                }
+            }
+            std::ranges::sort(vertex_clusters);
+
+            neighbours.clear();
+            for (size_t begin = 0, end; begin < vertex_clusters.size(); begin = end) {
+                for (end = begin + 1; end < vertex_clusters.size() && (vertex_clusters[end] >> 32) == (vertex_clusters[begin] >> 32); ++end);
+                for (size_t a = begin; a < end; ++a) {
+                    for (size_t b = begin; b < end; ++b) {
+                        if (a != b) {
+                            neighbours.push_back((vertex_clusters[a] << 32) | uint32_t(vertex_clusters[b]));
+                        }
+                    }
+                }
+            }
+            std::ranges::sort(neighbours);
+
+            // Collapse duplicate pairs into weighted neighbour lists (CSR)
+
+            neighbour_offsets.assign(cluster_count + 1, 0);
+            neighbour_weights.clear();
+            uint32_t unique_count = 0;
+            for (size_t begin = 0, end; begin < neighbours.size(); begin = end) {
+                for (end = begin + 1; end < neighbours.size() && neighbours[end] == neighbours[begin]; ++end);
+                neighbours[unique_count++] = neighbours[begin];
+                neighbour_weights.push_back(uint32_t(end - begin));
+                neighbour_offsets[(neighbours[begin] >> 32) + 1]++;
+            }
+            neighbours.resize(unique_count);
+            for (uint32_t c = 0; c < cluster_count; ++c) {
+                neighbour_offsets[c + 1] += neighbour_offsets[c];
+            }
+
+            // Grow groups from the first ungrouped cluster, adding the neighbour sharing the
+            //  most vertices with the group so far
+
+            groups.clear();
+            group_of.assign(cluster_count, Invalid);
+
+            for (uint32_t seed = 0; seed < cluster_count; ++seed) {
+                if (group_of[seed] != Invalid) {
+                    continue;
+                }
+
+                uint32_t group_idx = uint32_t(groups.size());
+                auto& group = groups.emplace_back();
+                group.clusters.push_back(seed);
+                group_of[seed] = group_idx;
+
+                while (group.clusters.size() < group_size) {
+                    uint32_t best = Invalid;
+                    uint32_t best_weight = 0;
+                    for (uint32_t member : group.clusters) {
+                        for (uint32_t n = neighbour_offsets[member]; n < neighbour_offsets[member + 1]; ++n) {
+                            uint32_t other = uint32_t(neighbours[n]);
+                            if (group_of[other] == Invalid && neighbour_weights[n] > best_weight) {
+                                best = other;
+                                best_weight = neighbour_weights[n];
+                            }
+                        }
+                    }
+
+                    if (best == Invalid) {
+                        break;
+                    }
+                    group.clusters.push_back(best);
+                    group_of[best] = group_idx;
+                }
+            }
+
+            // Groups left undersized by the greedy pass have mostly locked boundary and can not
+            //  be simplified, merge them into their most connected neighbouring group
+
+            for (uint32_t group_idx = 0; group_idx < groups.size(); ++group_idx) {
+                auto& group = groups[group_idx];
+                if (group.clusters.empty() || group.clusters.size() * 2 > group_size) {
+                    continue;
+                }
+
+                uint32_t best = Invalid;
+                uint32_t best_weight = 0;
+                for (uint32_t member : group.clusters) {
+                    for (uint32_t n = neighbour_offsets[member]; n < neighbour_offsets[member + 1]; ++n) {
+                        uint32_t other = group_of[uint32_t(neighbours[n])];
+                        if (other != group_idx && neighbour_weights[n] > best_weight) {
+                            best = other;
+                            best_weight = neighbour_weights[n];
+                        }
+                    }
+                }
+
+                if (best == Invalid) {
+                    continue;
+                }
+                for (uint32_t member : group.clusters) {
+                    groups[best].clusters.push_back(member);
+                    group_of[member] = best;
+                }
+                group.clusters.clear();
+            }
+
+            std::erase_if(groups, [](const Group& group) { return group.clusters.empty(); });
+
+            for (auto& group : groups) {
+                for (auto& cluster : group.clusters) {
+                    cluster = level_clusters[cluster];
+                }
+            }
+        }
+
+        void SimplifyGroup(const ClusterLodSet& out, Range<glm::vec3> positions, Group& group, GroupScratch& scratch)
+        {
+            // Merge the group into a local vertex space
+
+            scratch.indices.clear();
+            scratch.positions.clear();
+            scratch.group_vertices.clear();
+
+            float child_error = 0.f;
+            group.center = out.lods[group.clusters[0]].center;
+            group.radius = out.lods[group.clusters[0]].radius;
+
+            for (uint32_t c : group.clusters) {
+                auto& cluster = out.clusters[c];
+                auto& lod = out.lods[c];
+                child_error = std::max(child_error, lod.error);
+                MergeSpheres(group.center, group.radius, lod.center, lod.radius);
+
+                for (uint32_t t = 0; t < cluster.triangle_count; ++t) {
+                    auto& tri = out.triangles[cluster.triangle_offset + t];
+                    for (uint32_t k = 0; k < 3; ++k) {
+                        uint32_t v = out.vertices[cluster.vertex_offset + tri[k]];
+                        if (scratch.local_index[v] == Invalid) {
+                            scratch.local_index[v] = uint32_t(scratch.group_vertices.size());
+                            scratch.group_vertices.push_back(v);
+                            scratch.positions.push_back(positions[v]);
+                        }
+                        scratch.indices.push_back(scratch.local_index[v]);
+                    }
+                }
+            }
+
+            for (uint32_t v : scratch.group_vertices) {
+                scratch.local_index[v] = Invalid;
+            }
+
+            uint32_t triangle_count = uint32_t(scratch.indices.size() / 3);
+
+            auto& simplifier = scratch.simplifier;
+            simplifier.Begin({ scratch.indices.data(), scratch.indices.size() }, { scratch.positions.data(), scratch.positions.size() });
+            simplifier.Simplify(triangle_count / 2);
+
+            group.simplified = simplifier.TriangleCount() > 0
+                && float(simplifier.TriangleCount()) <= float(triangle_count) * ClusterSimplifyMinReduction;
+            if (!group.simplified) {
+                return;
+            }
+
+            group.error = std::max(child_error, simplifier.Error());
+
+            scratch.builder.Build(
+                { simplifier.triangles.data(), simplifier.triangles.size() },
+                { scratch.positions.data(), scratch.positions.size() },
+                group.meshlets);
+
+            // Back to range relative vertices
+
+            for (auto& v : group.meshlets.vertices) {
+                v = scratch.group_vertices[v];
+            }
+        }
+    };
+
+    inline
+    void BuildClusterLods(Importer& importer, Scene& scene)
+    {
+        auto& memory_pool = importer.memory_pool;
+        auto& settings = importer.settings;
+        auto& ranges = scene.geometry_ranges;
+
+        if (settings.meshlet_max_vertices < 3 || settings.meshlet_max_vertices > 256 || settings.meshlet_max_triangles < 1) {
+            Error("Invalid meshlet limits: max vertices = {}, max triangles = {}",
+                settings.meshlet_max_vertices, settings.meshlet_max_triangles);
+        }
+        if (settings.cluster_group_size < 2) {
+            Error("Invalid cluster group size: {}", settings.cluster_group_size);
+        }
+
+        using namespace std::chrono;
+        auto start = steady_clock::now();
+
+        std::vector<ClusterLodSet> sets(ranges.count);
+
+        auto build = [&](uint32_t i, bool parallel) {
+            auto& range = ranges[i];
+            auto& geometry = scene.geometries[range.geometry_idx];
+            ClusterLodBuilder builder {
+                .max_vertices = settings.meshlet_max_vertices,
+                .max_triangles = settings.meshlet_max_triangles,
+                .group_size = settings.cluster_group_size,
+            };
+            builder.Build(
+                geometry.indices.Slice(range.first_index, range.triangle_count * 3),
+                geometry.positions.Slice(range.vertex_offset, range.max_vertex + 1),
+                sets[i], parallel);
+        };
+
+        // Small ranges are built in parallel with each other, large ranges one at a time
+        //  with the groups of each level built in parallel
+
+#pragma omp parallel for schedule(dynamic)
+        for (uint32_t i = 0; i < ranges.count; ++i) {
+            if (ranges[i].triangle_count < ParallelClusterTriangleThreshold) {
+                build(i, false);
+            }
+        }
+
+        for (uint32_t i = 0; i < ranges.count; ++i) {
+            if (ranges[i].triangle_count >= ParallelClusterTriangleThreshold) {
+                build(i, true);
+            }
+        }
+
+        // Flatten into scene ranges, per geometry page
+
+        uint64_t total_cluster_count = 0;
+        uint64_t total_cluster_triangle_count = 0;
+        uint32_t max_level = 0;
+
+        std::vector<Meshlet> bases(ranges.count);
+
+        for (uint32_t p = 0; p < scene.geometries.count; ++p) {
+            auto& geometry = scene.geometries[p];
+
+            uint64_t cluster_count = 0;
+            uint64_t cluster_vertex_count = 0;
+            uint64_t cluster_triangle_count = 0;
+
+            for (uint32_t i = geometry.first_range; i < geometry.first_range + geometry.range_count; ++i) {
+                bases[i] = { .vertex_offset = uint32_t(cluster_vertex_count), .triangle_offset = uint32_t(cluster_triangle_count) };
+                ranges[i].first_cluster = uint32_t(cluster_count);
+                ranges[i].cluster_count = uint32_t(sets[i].clusters.size());
+                cluster_count += sets[i].clusters.size();
+                cluster_vertex_count += sets[i].vertices.size();
+                cluster_triangle_count += sets[i].triangles.size();
+                if (!sets[i].lods.empty()) {
+                    max_level = std::max(max_level, sets[i].lods.back().level);
+                }
+            }
+
+            if (cluster_vertex_count > UINT32_MAX || cluster_triangle_count > UINT32_MAX) {
+                Error("Cluster data exceeds 32 bit offsets in a geometry page, reduce the geometry page size");
+            }
+
+            geometry.clusters          = { memory_pool.Allocate<Meshlet>(cluster_count),                cluster_count          };
+            geometry.cluster_bounds    = { memory_pool.Allocate<MeshletBounds>(cluster_count),          cluster_count          };
+            geometry.cluster_lods      = { memory_pool.Allocate<ClusterLod>(cluster_count),             cluster_count          };
+            geometry.cluster_vertices  = { memory_pool.Allocate<uint32_t>(cluster_vertex_count),        cluster_vertex_count   };
+            geometry.cluster_triangles = { memory_pool.Allocate<Vec3<uint8_t>>(cluster_triangle_count), cluster_triangle_count };
+
+            total_cluster_count += cluster_count;
+            total_cluster_triangle_count += cluster_triangle_count;
+        }
+
+#pragma omp parallel for schedule(dynamic)
+        for (uint32_t i = 0; i < ranges.count; ++i) {
+            auto& geometry = scene.geometries[ranges[i].geometry_idx];
+            auto& set = sets[i];
+            auto& base = bases[i];
+
+            for (uint32_t j = 0; j < set.clusters.size(); ++j) {
+                auto cluster = set.clusters[j];
+                cluster.vertex_offset += base.vertex_offset;
+                cluster.triangle_offset += base.triangle_offset;
+                geometry.clusters[ranges[i].first_cluster + j] = cluster;
+                geometry.cluster_bounds[ranges[i].first_cluster + j] = set.bounds[j];
+                geometry.cluster_lods[ranges[i].first_cluster + j] = set.lods[j];
+            }
+
+            std::ranges::copy(set.vertices, &geometry.cluster_vertices[base.vertex_offset]);
+            std::ranges::copy(set.triangles, &geometry.cluster_triangles[base.triangle_offset]);
+        }
+
+        auto end = steady_clock::now();
+
+        fmt::println("Built cluster LOD hierarchy, {} clusters ({} triangles) over {} levels in {} ms",
+            total_cluster_count, total_cluster_triangle_count, total_cluster_count ? max_level + 1 : 0,
+            duration_cast<milliseconds>(end - start).count());
+    }
+}
@@ -0,0 +1,534 @@
+#pragma once
+
+#include <imp/imp_Importer.hpp>
+#include <imp/imp_CpuFeatures.hpp>
+
+#ifdef IMP_X86
+#  include <immintrin.h>
+#endif
+
+namespace imp::detail
+{
+    // Channels of the 8 bit or float data a format is stored as, or encoded from
+
+    inline
+    uint32_t GetChannelCount(TextureFormat format)
+    {
+        switch (format) {
+                using enum TextureFormat;
+            break;case RGBA8_UNORM:
+                  case RGBA8_SRGB:
+                  case BC7_SRGB:
+                  case BC7_UNORM:
+                  case RGBA16_SFLOAT:
+                  case BC6H_UFLOAT:
+                  case BC6H_SFLOAT:
+                return 4;
+            break;case RG8_UNORM:
+                  case BC5_UNORM:
+                return 2;
+            break;case R8_UNORM:
+                  case BC4_UNORM:
+                return 1;
+        }
+        std::unreachable();
+    }
+
+    inline
+    float SrgbToLinear(float v) noexcept
+    {
+        return v <= 0.04045f ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+    }
+
+    inline
+    float LinearToSrgb(float v) noexcept
+    {
+        return v <= 0.0031308f ? v * 12.92f : 1.055f * std::pow(v, 1.f / 2.4f) - 0.055f;
+    }
+
+    inline
+    uint8_t QuantizeUNorm8(float v) noexcept
+    {
+        return v > 0.f ? uint8_t(std::min(v, 1.f) * 255.f + 0.5f) : 0;
+    }
+
+    inline
+    float EvaluateChannelOp(const InMaterial::ChannelOp& op, float value) noexcept
+    {
+        value = value * op.scale + op.bias;
+        if (op.invert) {
+            value = 1.f - value;
+        }
+        switch (op.conversion) {
+            break;case InMaterial::ChannelConversion::None:
+            break;case InMaterial::ChannelConversion::SrgbToLinear: value = SrgbToLinear(std::clamp(value, 0.f, 1.f));
+            break;case InMaterial::ChannelConversion::LinearToSrgb: value = LinearToSrgb(std::clamp(value, 0.f, 1.f));
+        }
+        return value;
+    }
+
+    // Renormalizes a tangent space normal encoded in [0, 1], degenerate normals face +Z
+
+    inline
+    void NormalizeNormalXY(float& x, float& y, float& z) noexcept
+    {
+        float nx = x * 2.f - 1.f;
+        float ny = y * 2.f - 1.f;
+        float nz = z * 2.f - 1.f;
+        float length = std::sqrt(nx * nx + ny * ny + nz * nz);
+        bool valid = length > 1e-6f;
+        x = (valid ? nx / length : 0.f) * 0.5f + 0.5f;
+        y = (valid ? ny / length : 0.f) * 0.5f + 0.5f;
+        z = (valid ? nz / length : 1.f) * 0.5f + 0.5f;
+    }
+
+    inline
+    glm::vec4 NormalizeNormalXY(glm::vec4 value) noexcept
+    {
+        NormalizeNormalXY(value.x, value.y, value.z);
+        return value;
+    }
+
+    // Source image at 8 bits per channel, pixels stored interleaved
+
+    struct ChannelSource
+    {
+        const uint8_t* pixels = nullptr;
+        glm::uvec2     size = {};
+        uint32_t       channels = 0;
+    };
+
+    // A texture process compiled against its decoded sources. Inputs and outputs are both 8 bit,
+    //  so every channel op reduces to a 256 entry lookup table applied to a strided byte read.
+    //  Constant channels read a single byte with zero stride. SIMD paths are selected per run
+    //  from the CPU's features.
+
+    struct ChannelKernel
+    {
+        struct Channel
+        {
+            const uint8_t*            pixels;
+            uint32_t                  stride;
+            bool                      identity;
+            std::array<uint8_t, 256>  table;
+            std::array<float, 256>    values;
+
+            // Whole pixels holding the channel at byte shift / 8, and the table moved to the
+            //  channel's output byte, for gathering with 32 bit lanes
+
+            const uint8_t*            source;
+            uint32_t                  shift;
+            std::array<uint32_t, 256> wide_table;
+        };
+
+        enum class Mode
+        {
+            Table,
+            Swizzle,
+            Copy,
+            Normal,
+            Function,
+        };
+
+        static constexpr uint8_t ConstantByte = 0;
+
+        Mode                   mode = Mode::Table;
+        uint32_t               out_channels = 0;
+        std::array<Channel, 4> channels;
+
+        const InMaterial::TextureProcess* process = nullptr;
+
+        // Identity reads of one RGBA8 source are written with byte shuffles, or copied
+
+        const uint8_t*          swizzle_pixels = nullptr;
+        std::array<uint8_t, 16> swizzle_mask;
+
+    public:
+        // Returns false if the sources are missing or differ in size
+
+        bool Compile(const InMaterial::TextureProcess& _process, std::span<const ChannelSource> sources, glm::uvec2 size)
+        {
+            process = &_process;
+            out_channels = GetChannelCount(process->format);
+
+            bool swizzle = true;
+            bool in_order = true;
+            swizzle_pixels = nullptr;
+            for (uint32_t c = 0; c < 4; ++c) {
+                auto& op = process->channels[c];
+                auto& channel = channels[c];
+
+                const ChannelSource* source = nullptr;
+                if (op.input != InMaterial::ChannelOp::Constant) {
+                    if (op.input < 0 || op.input >= int32_t(sources.size())) {
+                        return false;
+                    }
+                    source = &sources[op.input];
+                    if (!source->pixels || source->size != size) {
+                        return false;
+                    }
+                }
+
+                // Constant inputs and channels missing from the source read as a constant
+
+                float constant = op.value;
+                if (source && op.channel >= source->channels) {
+                    constant = op.channel == 3 ? 1.f : 0.f;
+                    source = nullptr;
+                }
+
+                if (source) {
+                    channel.pixels = source->pixels + op.channel;
+                    channel.stride = source->channels;
+                    channel.source = source->pixels;
+                    channel.shift = op.channel * 8;
+                    for (uint32_t x = 0; x < 256; ++x) {
+                        channel.values[x] = EvaluateChannelOp(op, float(x) / 255.f);
+                        channel.table[x] = QuantizeUNorm8(channel.values[x]);
+                    }
+                } else {
+                    channel.pixels = &ConstantByte;
+                    channel.stride = 0;
+                    channel.source = &ConstantByte;
+                    channel.shift = 0;
+                    channel.values.fill(EvaluateChannelOp(op, constant));
+                    channel.table.fill(QuantizeUNorm8(channel.values[0]));
+                }
+
+                for (uint32_t x = 0; x < 256; ++x) {
+                    channel.wide_table[x] = uint32_t(channel.table[x]) << (c * 8);
+                }
+
+                channel.identity = true;
+                for (uint32_t x = 0; x < 256; ++x) {
+                    channel.identity &= channel.table[x] == x;
+                }
+
+                if (c < out_channels) {
+                    swizzle &= source && channel.identity && source->channels == 4
+                        && (c == 0 || source->pixels == swizzle_pixels);
+                    in_order &= op.channel == c;
+                    if (c == 0 && source) {
+                        swizzle_pixels = source->pixels;
+                    }
+                }
+            }
+
+            if (process->fn) {
+                mode = Mode::Function;
+            } else if (process->normal_xy) {
+                mode = Mode::Normal;
+            } else if (swizzle) {
+                mode = in_order && out_channels == 4 ? Mode::Copy : Mode::Swizzle;
+                swizzle_mask.fill(0x80);
+                for (uint32_t p = 0; p < 4; ++p) {
+                    for (uint32_t c = 0; c < out_channels; ++c) {
+                        swizzle_mask[p * out_channels + c] = uint8_t(p * 4 + process->channels[c].channel);
+                    }
+                }
+            } else {
+                mode = Mode::Table;
+            }
+
+            return true;
+        }
+
+        template<uint32_t OutChannels>
+        void RunTable(uint64_t first, uint64_t count, uint8_t* out) const noexcept
+        {
+            for (uint64_t i = first; i < first + count; ++i) {
+                for (uint32_t c = 0; c < OutChannels; ++c) {
+                    auto& channel = channels[c];
+                    out[i * OutChannels + c] = channel.table[channel.pixels[i * channel.stride]];
+                }
+            }
+        }
+
+#ifdef IMP_X86
+        // Eight pixels per step. Channel bytes are widened to 32 bit lanes, looked up with a
+        //  gather from the wide tables and merged with ORs. Returns the first pixel not written.
+
+        template<uint32_t OutChannels>
+        IMP_TARGET("avx2")
+        uint64_t RunTableAvx2(uint64_t first, uint64_t count, uint8_t* out) const noexcept
+        {
+            uint64_t i = first;
+            for (; i + 8 <= first + count; i += 8) {
+                __m256i merged = _mm256_setzero_si256();
+                for (uint32_t c = 0; c < OutChannels; ++c) {
+                    auto& channel = channels[c];
+                    __m256i index;
+                    switch (channel.stride) {
+                        break;case 0:
+                            index = _mm256_setzero_si256();
+                        break;case 1:
+                            index = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(channel.source + i)));
+                        break;case 2:
+                            index = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(channel.source + i * 2)));
+                        break;default:
+                            index = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(channel.source + i * 4));
+                    }
+                    index = _mm256_and_si256(_mm256_srl_epi32(index, _mm_cvtsi32_si128(int32_t(channel.shift))), _mm256_set1_epi32(0xFF));
+                    merged = _mm256_or_si256(merged,
+                        _mm256_i32gather_epi32(reinterpret_cast<const int32_t*>(channel.wide_table.data()), index, 4));
+                }
+
+                if constexpr (OutChannels == 4) {
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i * 4), merged);
+                } else if constexpr (OutChannels == 2) {
+                    __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(merged, merged), 0b1000);
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * 2), _mm256_castsi256_si128(packed));
+                } else {
+                    __m256i packed = _mm256_packus_epi16(_mm256_packus_epi32(merged, merged), merged);
+                    packed = _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0));
+                    _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), _mm256_castsi256_si128(packed));
+                }
+            }
+            return i;
+        }
+
+        template<uint32_t OutChannels>
+        IMP_TARGET("ssse3")
+        uint64_t RunSwizzleSsse3(uint64_t first, uint64_t count, uint8_t* out) const noexcept
+        {
+            uint64_t i = first;
+            __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(swizzle_mask.data()));
+            for (; i + 4 <= first + count; i += 4) {
+                __m128i v = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(swizzle_pixels + i * 4)), mask);
+                if constexpr (OutChannels == 4) {
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * 4), v);
+                } else if constexpr (OutChannels == 2) {
+                    _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i * 2), v);
+                } else {
+                    uint32_t packed = uint32_t(_mm_cvtsi128_si32(v));
+                    std::memcpy(out + i, &packed, 4);
+                }
+            }
+            return i;
+        }
+#endif
+
+        template<uint32_t OutChannels>
+        void RunTableRow(uint64_t first, uint64_t count, uint8_t* out) const noexcept
+        {
+            uint64_t i = first;
+#ifdef IMP_X86
+            if (GetCpuFeatures().avx2) {
+                i = RunTableAvx2<OutChannels>(first, count, out);
+            }
+#endif
+            RunTable<OutChannels>(i, first + count - i, out);
+        }
+
+        template<uint32_t OutChannels>
+        void RunSwizzle(uint64_t first, uint64_t count, uint8_t* out) const noexcept
+        {
+            uint64_t i = first;
+#ifdef IMP_X86
+            if (GetCpuFeatures().ssse3) {
+                i = RunSwizzleSsse3<OutChannels>(first, count, out);
+            }
+#endif
+            RunTableRow<OutChannels>(i, first + count - i, out);
+        }
+
+        // Normals need all three channel op results, so are renormalized in float. Channel
+        //  values are looked up a block at a time so the normalization runs in SIMD.
+
+        template<uint32_t OutChannels>
+        void RunNormal(uint64_t first, uint64_t count, uint8_t* out) const noexcept
+        {
+            constexpr uint32_t BlockSize = 64;
+            std::array<std::array<float, BlockSize>, 4> values;
+
+            for (uint64_t block = first; block < first + count; block += BlockSize) {
+                uint32_t block_count = uint32_t(std::min<uint64_t>(BlockSize, first + count - block));
+
+                for (uint32_t c = 0; c < 4; ++c) {
+                    auto& channel = channels[c];
+                    for (uint32_t j = 0; j < block_count; ++j) {
+                        values[c][j] = channel.values[channel.pixels[(block + j) * channel.stride]];
+                    }
+                }
+
+#pragma omp simd
+                for (uint32_t j = 0; j < block_count; ++j) {
+                    NormalizeNormalXY(values[0][j], values[1][j], values[2][j]);
+                }
+
+                for (uint32_t j = 0; j < block_count; ++j) {
+                    for (uint32_t c = 0; c < OutChannels; ++c) {
+                        out[(block + j) * OutChannels + c] = QuantizeUNorm8(values[c][j]);
+                    }
+                }
+            }
+        }
+
+        // Slow path, calls the process function per pixel on the channel op results
+
+        template<uint32_t OutChannels>
+        void RunFunction(uint64_t first, uint64_t count, uint8_t* out) const
+        {
+            for (uint64_t i = first; i < first + count; ++i) {
+                glm::vec4 in;
+                for (uint32_t c = 0; c < 4; ++c) {
+                    in[c] = channels[c].values[channels[c].pixels[i * channels[c].stride]];
+                }
+                auto res = process->fn(in);
+                if (process->normal_xy) {
+                    res = NormalizeNormalXY(res);
+                }
+                for (uint32_t c = 0; c < OutChannels; ++c) {
+                    out[i * OutChannels + c] = QuantizeUNorm8(res[c]);
+                }
+            }
+        }
+
+        template<uint32_t OutChannels>
+        void Run(uint64_t first, uint64_t count, uint8_t* out) const
+        {
+            switch (mode) {
+                break;case Mode::Table:    RunTableRow<OutChannels>(first, count, out);
+                break;case Mode::Swizzle:  RunSwizzle<OutChannels>(first, count, out);
+                break;case Mode::Copy:     std::memcpy(out + first * OutChannels, swizzle_pixels + first * 4, count * 4);
+                break;case Mode::Normal:   RunNormal<OutChannels>(first, count, out);
+                break;case Mode::Function: RunFunction<OutChannels>(first, count, out);
+            }
+        }
+
+        // Writes all rows, in parallel when requested
+
+        void RunRows(glm::uvec2 size, uint8_t* out, bool parallel) const
+        {
+#pragma omp parallel for schedule(dynamic, 16) if(parallel)
+            for (uint32_t y = 0; y < size.y; ++y) {
+                uint64_t first = uint64_t(y) * size.x;
+                switch (out_channels) {
+                    break;case 1: Run<1>(first, size.x, out);
+                    break;case 2: Run<2>(first, size.x, out);
+                    break;case 4: Run<4>(first, size.x, out);
+                }
+            }
+        }
+    };
+
+    // Source image at 32 bit float per channel, pixels stored interleaved
+
+    struct FloatChannelSource
+    {
+        const float* pixels = nullptr;
+        glm::uvec2   size = {};
+        uint32_t     channels = 0;
+    };
+
+    // HDR counterpart of ChannelKernel. Channel ops are evaluated per pixel as float inputs
+    //  don't reduce to a table, output is always RGBA.
+
+    struct FloatChannelKernel
+    {
+        struct Channel
+        {
+            const float* pixels;
+            uint32_t     stride;
+            float        constant;
+        };
+
+        std::array<Channel, 4> channels;
+
+        const InMaterial::TextureProcess* process = nullptr;
+
+    public:
+        // Returns false if the sources are missing or differ in size
+
+        bool Compile(const InMaterial::TextureProcess& _process, std::span<const FloatChannelSource> sources, glm::uvec2 size)
+        {
+            process = &_process;
+
+            for (uint32_t c = 0; c < 4; ++c) {
+                auto& op = process->channels[c];
+                auto& channel = channels[c];
+
+                const FloatChannelSource* source = nullptr;
+                if (op.input != InMaterial::ChannelOp::Constant) {
+                    if (op.input < 0 || op.input >= int32_t(sources.size())) {
+                        return false;
+                    }
+                    source = &sources[op.input];
+                    if (!source->pixels || source->size != size) {
+                        return false;
+                    }
+                }
+
+                channel.constant = op.value;
+                if (source && op.channel >= source->channels) {
+                    channel.constant = op.channel == 3 ? 1.f : 0.f;
+                    source = nullptr;
+                }
+
+                if (source) {
+                    channel.pixels = source->pixels + op.channel;
+                    channel.stride = source->channels;
+                } else {
+                    channel.pixels = &channel.constant;
+                    channel.stride = 0;
+                }
+            }
+
+            return true;
+        }
+
+        // Channel ops run a channel at a time, so scale, bias and invert vectorize. Conversions
+        //  and the function fallback run per pixel.
+
+        void Run(uint64_t first, uint64_t count, float* out) const
+        {
+            for (uint32_t c = 0; c < 4; ++c) {
+                auto& op = process->channels[c];
+                auto& channel = channels[c];
+                float* dst = out + first * 4 + c;
+
+                if (channel.stride == 0 || op.conversion != InMaterial::ChannelConversion::None) {
+                    for (uint64_t i = 0; i < count; ++i) {
+                        dst[i * 4] = EvaluateChannelOp(op, channel.pixels[(first + i) * channel.stride]);
+                    }
+                    continue;
+                }
+
+                const float* src = channel.pixels + first * channel.stride;
+                uint64_t stride = channel.stride;
+                float scale = op.scale;
+                float bias = op.bias;
+                bool invert = op.invert;
+#pragma omp simd
+                for (uint64_t i = 0; i < count; ++i) {
+                    float value = src[i * stride] * scale + bias;
+                    dst[i * 4] = invert ? 1.f - value : value;
+                }
+            }
+
+            if (process->fn) {
+                for (uint64_t i = first; i < first + count; ++i) {
+                    auto value = process->fn(glm::vec4(out[i * 4 + 0], out[i * 4 + 1], out[i * 4 + 2], out[i * 4 + 3]));
+                    for (uint32_t c = 0; c < 4; ++c) {
+                        out[i * 4 + c] = value[c];
+                    }
+                }
+            }
+
+            if (process->normal_xy) {
+#pragma omp simd
+                for (uint64_t i = first; i < first + count; ++i) {
+                    NormalizeNormalXY(out[i * 4 + 0], out[i * 4 + 1], out[i * 4 + 2]);
+                }
+            }
+        }
+
+        void RunRows(glm::uvec2 size, float* out, bool parallel) const
+        {
+#pragma omp parallel for schedule(dynamic, 16) if(parallel)
+            for (uint32_t y = 0; y < size.y; ++y) {
+                Run(uint64_t(y) * size.x, size.x, out);
+            }
+        }
+    };
+}
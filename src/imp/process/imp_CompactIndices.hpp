@@ -0,0 +1,145 @@
+#pragma once
+
+#include <imp/imp_Importer.hpp>
+
+#include <utility>
+
+namespace imp::detail
+{
+    // Each range's data starts aligned to this, satisfying index buffer offset alignment
+    //  requirements for every index width
+
+    constexpr uint64_t CompactIndexAlignment = 4;
+
+    // The all ones index of each width is reserved for primitive restart
+
+    inline
+    IndexFormat ChooseIndexFormat(uint32_t max_vertex, bool allow_uint8)
+    {
+        if (allow_uint8 && max_vertex < UINT8_MAX) {
+            return IndexFormat::UInt8;
+        }
+        if (max_vertex < UINT16_MAX) {
+            return IndexFormat::UInt16;
+        }
+        return IndexFormat::UInt32;
+    }
+
+    inline
+    uint32_t GetIndexSize(IndexFormat format)
+    {
+        switch (format) {
+            break;case IndexFormat::UInt8:  return 1;
+            break;case IndexFormat::UInt16: return 2;
+            break;case IndexFormat::UInt32: return 4;
+        }
+        std::unreachable();
+    }
+
+    // Narrowing may run in place, out never passes the index being read
+
+    template<class T>
+    void NarrowIndices(Range<uint32_t> indices, std::byte* out)
+    {
+        for (uint32_t j = 0; j < indices.count; ++j) {
+            T index = T(indices[j]);
+            std::memcpy(out + j * sizeof(T), &index, sizeof(T));
+        }
+    }
+
+    inline
+    void NarrowIndices(Range<uint32_t> indices, std::byte* out, IndexFormat format)
+    {
+        switch (format) {
+            break;case IndexFormat::UInt8:  NarrowIndices<uint8_t>(indices, out);
+            break;case IndexFormat::UInt16: NarrowIndices<uint16_t>(indices, out);
+            break;case IndexFormat::UInt32: std::memmove(out, indices.begin, indices.count * sizeof(uint32_t));
+        }
+    }
+
+    inline
+    void CompactIndices(Importer& importer, Scene& scene)
+    {
+        auto& settings = importer.settings;
+        auto& ranges = scene.geometry_ranges;
+
+        using namespace std::chrono;
+        auto start = steady_clock::now();
+
+        auto align = [](uint64_t offset) {
+            return (offset + CompactIndexAlignment - 1) / CompactIndexAlignment * CompactIndexAlignment;
+        };
+
+        // Choose widths and lay out ranges per geometry page. Aligned range starts keep every
+        //  compact offset at or before the 32 bit offset of the same index.
+
+        uint64_t full_bytes = 0;
+        uint64_t total_bytes = 0;
+        uint32_t format_counts[3] = {};
+
+        for (uint32_t p = 0; p < scene.geometries.count; ++p) {
+            auto& geometry = scene.geometries[p];
+
+            uint64_t index_bytes = 0;
+            uint64_t lod_index_bytes = 0;
+
+            for (uint32_t i = geometry.first_range; i < geometry.first_range + geometry.range_count; ++i) {
+                auto& range = ranges[i];
+                range.index_format = ChooseIndexFormat(range.max_vertex, settings.allow_uint8_indices);
+                format_counts[uint32_t(range.index_format)]++;
+
+                uint32_t index_size = GetIndexSize(range.index_format);
+
+                range.index_byte_offset = index_bytes;
+                index_bytes = align(index_bytes + uint64_t(range.triangle_count) * 3 * index_size);
+
+                range.lod_index_byte_offset = lod_index_bytes;
+                for (uint32_t j = 0; j < range.lod_count; ++j) {
+                    lod_index_bytes += uint64_t(geometry.lods[range.first_lod + j].triangle_count) * 3 * index_size;
+                }
+                lod_index_bytes = align(lod_index_bytes);
+            }
+
+            geometry.compact_indices     = { reinterpret_cast<std::byte*>(geometry.indices.begin),     index_bytes     };
+            geometry.compact_lod_indices = { reinterpret_cast<std::byte*>(geometry.lod_indices.begin), lod_index_bytes };
+
+            full_bytes += (geometry.indices.count + geometry.lod_indices.count) * sizeof(uint32_t);
+            total_bytes += index_bytes + lod_index_bytes;
+        }
+
+        // Narrow in place over the 32 bit indices, which are released afterwards. Ranges are
+        //  written in order so no range overwrites indices that have not been read yet.
+
+#pragma omp parallel for schedule(dynamic)
+        for (uint32_t p = 0; p < scene.geometries.count; ++p) {
+            auto& geometry = scene.geometries[p];
+
+            for (uint32_t i = geometry.first_range; i < geometry.first_range + geometry.range_count; ++i) {
+                auto& range = ranges[i];
+
+                NarrowIndices(geometry.indices.Slice(range.first_index, range.triangle_count * 3),
+                    &geometry.compact_indices[range.index_byte_offset], range.index_format);
+
+                // LOD levels of a range are contiguous, narrow them in one go
+
+                if (range.lod_count) {
+                    auto& first = geometry.lods[range.first_lod];
+                    auto& last = geometry.lods[range.first_lod + range.lod_count - 1];
+                    uint32_t lod_index_count = last.first_index + last.triangle_count * 3 - first.first_index;
+                    NarrowIndices(geometry.lod_indices.Slice(first.first_index, lod_index_count),
+                        &geometry.compact_lod_indices[range.lod_index_byte_offset], range.index_format);
+                }
+            }
+
+            geometry.indices = {};
+            geometry.lod_indices = {};
+        }
+
+        auto end = steady_clock::now();
+
+        fmt::println("Compacted indices, {} UInt8 / {} UInt16 / {} UInt32 ranges ({} -> {} bytes) in {} ms",
+            format_counts[0], format_counts[1], format_counts[2],
+            full_bytes, total_bytes,
+            duration_cast<milliseconds>(end - start).count());
+    }
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <imp/imp_Importer.hpp>
+
+namespace imp::detail
+{
+    // Processed texture compared by layout and data, data is only compared on a hash match
+
+    struct TextureContentKey
+    {
+        const Texture* texture;
+        uint64_t       hash;
+
+        bool operator==(const TextureContentKey& other) const noexcept
+        {
+            auto& a = *texture;
+            auto& b = *other.texture;
+            return hash == other.hash
+                && a.size == b.size
+                && a.format == b.format
+                && a.mip_count == b.mip_count
+                && a.data.count == b.data.count
+                && std::memcmp(a.data.begin, b.data.begin, a.data.count) == 0;
+        }
+    };
+
+    struct TextureContentKeyHash
+    {
+        using is_avalanching = void;
+        uint64_t operator()(const TextureContentKey& key) const noexcept
+        {
+            return key.hash;
+        }
+    };
+
+    inline
+    void RemapMaterialTextures(Material& material, std::span<const int32_t> remap)
+    {
+        for (int32_t* texture : {
+                &material.albedo_alpha_texture,
+                &material.metalness_texture,
+                &material.roughness_texture,
+                &material.normal_texture,
+                &material.emission_texture,
+                &material.transmission_texture }) {
+            if (*texture >= 0) {
+                *texture = remap[*texture];
+            }
+        }
+    }
+
+    // Collapses textures with identical processed output to the first one, compacting the scene
+    //  texture list and remapping material references
+
+    inline
+    void DeduplicateTextures(Importer& importer, Scene& scene)
+    {
+        (void)importer;
+
+        auto& textures = scene.textures;
+
+        using namespace std::chrono;
+        auto start = steady_clock::now();
+
+        std::vector<uint64_t> hashes(textures.count);
+
+#pragma omp parallel for schedule(dynamic)
+        for (uint32_t i = 0; i < textures.count; ++i) {
+            auto& texture = textures[i];
+            uint64_t layout = ankerl::unordered_dense::detail::wyhash::mix(
+                uint64_t(texture.size.x) << 32 | texture.size.y,
+                uint64_t(texture.format) << 32 | texture.mip_count);
+            hashes[i] = ankerl::unordered_dense::detail::wyhash::mix(
+                ankerl::unordered_dense::detail::wyhash::hash(texture.data.begin, texture.data.count), layout);
+        }
+
+        // Textures are moved down as they are compacted, so keys reference unique textures by
+        //  their final index, which is never written again
+
+        std::vector<int32_t> remap(textures.count);
+        ankerl::unordered_dense::map<TextureContentKey, int32_t, TextureContentKeyHash> unique_textures;
+
+        uint32_t unique_count = 0;
+        uint64_t removed_bytes = 0;
+
+        for (uint32_t i = 0; i < textures.count; ++i) {
+            auto f = unique_textures.find(TextureContentKey { &textures[i], hashes[i] });
+            if (f != unique_textures.end()) {
+                remap[i] = f->second;
+                removed_bytes += textures[i].data.count;
+                continue;
+            }
+            textures[unique_count] = textures[i];
+            unique_textures.insert({ TextureContentKey { &textures[unique_count], hashes[i] }, int32_t(unique_count) });
+            remap[i] = int32_t(unique_count++);
+        }
+
+        uint32_t removed_count = uint32_t(textures.count) - unique_count;
+        textures.count = unique_count;
+
+        for (uint32_t i = 0; i < scene.materials.count; ++i) {
+            RemapMaterialTextures(scene.materials[i], remap);
+        }
+
+        auto end = steady_clock::now();
+
+        fmt::println("Deduplicated textures, removed {} of {} ({} bytes) in {} ms",
+            removed_count, removed_count + unique_count, removed_bytes,
+            duration_cast<milliseconds>(end - start).count());
+    }
+}
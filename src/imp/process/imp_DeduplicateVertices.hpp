@@ -0,0 +1,143 @@
+#pragma once
+
+#include <imp/imp_Importer.hpp>
+
+#include "imp_ProcessGeometry.hpp"
+
+namespace imp::detail
+{
+    // Final quantized vertex, compared and hashed bitwise. Tex coords are the packed bits
+    //  of the range's tex coord format, zero extended.
+
+    struct QuantizedVertexKey
+    {
+        glm::vec3     position;
+        Basis         tangent_space;
+        uint32_t      tex_coord;
+
+        bool operator==(const QuantizedVertexKey& other) const noexcept
+        {
+            return std::memcmp(this, &other, sizeof(QuantizedVertexKey)) == 0;
+        }
+    };
+
+    static_assert(sizeof(QuantizedVertexKey) == 20);
+
+    struct QuantizedVertexKeyHash
+    {
+        using is_avalanching = void;
+        uint64_t operator()(const QuantizedVertexKey& key) const noexcept
+        {
+            return ankerl::unordered_dense::detail::wyhash::hash(&key, sizeof(key));
+        }
+    };
+
+    inline
+    void DeduplicateVertices(Importer& importer, Scene& scene)
+    {
+        (void)importer;
+
+        auto& ranges = scene.geometry_ranges;
+
+        using namespace std::chrono;
+        auto start = steady_clock::now();
+
+        // Deduplicate each range in place, compacting unique vertices to the front of the range
+
+        std::vector<uint32_t> unique_counts(ranges.count);
+
+#pragma omp parallel
+        {
+            ankerl::unordered_dense::map<QuantizedVertexKey, uint32_t, QuantizedVertexKeyHash> unique_vertices;
+            std::vector<uint32_t> remap;
+
+#pragma omp for schedule(dynamic)
+            for (uint32_t i = 0; i < ranges.count; ++i) {
+                auto& range = ranges[i];
+                auto& geometry = scene.geometries[range.geometry_idx];
+                uint32_t vertex_count = range.max_vertex + 1;
+
+                auto positions = geometry.positions.Slice(range.vertex_offset, vertex_count);
+                auto tangent_spaces = geometry.tangent_spaces.Slice(range.vertex_offset, vertex_count);
+                auto tex_coords = &geometry.tex_coords[range.tex_coord_byte_offset];
+                size_t tex_coord_size = GetTexCoordSize(range.tex_coord_format);
+
+                unique_vertices.clear();
+                unique_vertices.reserve(vertex_count);
+                remap.resize(vertex_count);
+
+                uint32_t unique_count = 0;
+                for (uint32_t v = 0; v < vertex_count; ++v) {
+                    QuantizedVertexKey key {
+                        .position = positions[v],
+                        .tangent_space = tangent_spaces[v],
+                        .tex_coord = 0,
+                    };
+                    std::memcpy(&key.tex_coord, tex_coords + v * tex_coord_size, tex_coord_size);
+
+                    auto[iter, inserted] = unique_vertices.insert({ key, unique_count });
+                    if (inserted) {
+                        positions[unique_count] = positions[v];
+                        tangent_spaces[unique_count] = tangent_spaces[v];
+                        std::memmove(tex_coords + unique_count * tex_coord_size, tex_coords + v * tex_coord_size, tex_coord_size);
+                        unique_count++;
+                    }
+                    remap[v] = iter->second;
+                }
+
+                auto indices = geometry.indices.Slice(range.first_index, range.triangle_count * 3);
+                for (uint32_t j = 0; j < indices.count; ++j) {
+                    indices[j] = remap[indices[j]];
+                }
+
+                unique_counts[i] = unique_count;
+            }
+        }
+
+        // Shift ranges down over the removed vertices. Ranges only move towards the start
+        //  of their page, so each page is done in order.
+
+        uint64_t original = 0;
+        uint64_t removed = 0;
+
+#pragma omp parallel for schedule(dynamic) reduction(+: original, removed)
+        for (uint32_t p = 0; p < scene.geometries.count; ++p) {
+            auto& geometry = scene.geometries[p];
+
+            uint32_t vertex_count = 0;
+            uint64_t tex_coord_bytes = 0;
+            for (uint32_t i = geometry.first_range; i < geometry.first_range + geometry.range_count; ++i) {
+                auto& range = ranges[i];
+                uint32_t unique_count = unique_counts[i];
+                uint64_t unique_tex_coord_bytes = uint64_t(unique_count) * GetTexCoordSize(range.tex_coord_format);
+
+                if (range.vertex_offset != vertex_count) {
+                    std::memmove(&geometry.positions[vertex_count], &geometry.positions[range.vertex_offset], unique_count * sizeof(glm::vec3));
+                    std::memmove(&geometry.tangent_spaces[vertex_count], &geometry.tangent_spaces[range.vertex_offset], unique_count * sizeof(Basis));
+                }
+                if (range.tex_coord_byte_offset != tex_coord_bytes) {
+                    std::memmove(&geometry.tex_coords[tex_coord_bytes], &geometry.tex_coords[range.tex_coord_byte_offset], unique_tex_coord_bytes);
+                }
+
+                range.vertex_offset = vertex_count;
+                range.max_vertex = unique_count - 1;
+                range.tex_coord_byte_offset = tex_coord_bytes;
+                vertex_count += unique_count;
+                tex_coord_bytes += unique_tex_coord_bytes;
+            }
+
+            original += geometry.positions.count;
+            removed += geometry.positions.count - vertex_count;
+
+            geometry.positions.count = vertex_count;
+            geometry.tangent_spaces.count = vertex_count;
+            geometry.tex_coords.count = tex_coord_bytes;
+        }
+
+        auto end = steady_clock::now();
+
+        fmt::println("Deduplicated vertices, removed {} of {} ({:.2f}%) in {} ms",
+            removed, original, original ? 100.0 * double(removed) / double(original) : 0.0,
+            duration_cast<milliseconds>(end - start).count());
+    }
+}
@@ -0,0 +1,585 @@
+#pragma once
+
+#include <imp/imp_Importer.hpp>
+
+#include "imp_MeshAdjacency.hpp"
+#include "imp_OptimizeVertexCache.hpp"
+
+#include <numeric>
+
+namespace imp::detail
+{
+    // Area weighted plane quadric. Evaluates to the weighted mean squared distance from
+    //  all accumulated planes.
+
+    struct Quadric
+    {
+        double xx, yy, zz, xy, xz, yz, xw, yw, zw, ww;
+        double weight;
+
+        static Quadric FromPlane(glm::vec3 normal, float distance, double weight)
+        {
+            double a = normal.x, b = normal.y, c = normal.z, d = distance;
+            return {
+                a * a * weight, b * b * weight, c * c * weight,
+                a * b * weight, a * c * weight, b * c * weight,
+                a * d * weight, b * d * weight, c * d * weight,
+                d * d * weight,
+                weight,
+            };
+        }
+
+        Quadric& operator+=(const Quadric& other) noexcept
+        {
+            xx += other.xx; yy += other.yy; zz += other.zz;
+            xy += other.xy; xz += other.xz; yz += other.yz;
+            xw += other.xw; yw += other.yw; zw += other.zw;
+            ww += other.ww;
+            weight += other.weight;
+            return *this;
+        }
+
+        double Evaluate(glm::vec3 p) const noexcept
+        {
+            double x = p.x, y = p.y, z = p.z;
+            double error = x * x * xx + y * y * yy + z * z * zz
+                + 2.0 * (x * y * xy + x * z * xz + y * z * yz)
+                + 2.0 * (x * xw + y * yw + z * zw)
+                + ww;
+            return weight > 0.0 ? std::max(error, 0.0) / weight : 0.0;
+        }
+    };
+
+    struct PositionKey
+    {
+        glm::vec3 position;
+
+        bool operator==(const PositionKey& other) const noexcept
+        {
+            return std::memcmp(this, &other, sizeof(PositionKey)) == 0;
+        }
+    };
+
+    struct PositionKeyHash
+    {
+        using is_avalanching = void;
+        uint64_t operator()(const PositionKey& key) const noexcept
+        {
+            return ankerl::unordered_dense::detail::wyhash::hash(&key, sizeof(key));
+        }
+    };
+
+    // Iterative half-edge collapse simplifier. Collapses only move a vertex onto an existing
+    //  neighbour, so every level indexes the original vertices.
+    //
+    // Vertices sharing a position with another vertex lie on a Basis or UV seam. A seam vertex
+    //  with exactly two copies may collapse along the seam, moving both copies onto the two
+    //  copies of the target so the seam never cracks. Vertices on open borders and where
+    //  seams meet are locked.
+    //
+    // Each pass picks the cheapest collapse per vertex, then applies them in cost order while
+    //  locking the one-ring of every collapsed vertex, keeping collapses within a pass independent.
+
+    struct MeshSimplifier
+    {
+        static constexpr uint32_t Invalid = UINT32_MAX;
+
+        Range<glm::vec3> positions;
+        uint32_t         vertex_count;
+
+        std::vector<uint32_t> triangles;
+        std::vector<uint32_t> canonical;
+        std::vector<uint32_t> partner;
+        std::vector<uint8_t>  locked;
+        std::vector<Quadric>  quadrics;
+        std::vector<uint32_t> remap;
+        double                max_error;
+
+        VertexTriangleAdjacency adjacency;
+        std::vector<float>      best_cost;
+        std::vector<uint32_t>   best_target;
+        std::vector<uint32_t>   order;
+        std::vector<uint8_t>    pass_locked;
+
+        ankerl::unordered_dense::map<PositionKey, uint32_t, PositionKeyHash> unique_positions;
+        ankerl::unordered_dense::set<uint64_t>                               edges;
+        ankerl::unordered_dense::set<uint64_t>                               vertex_edges;
+        std::vector<uint32_t>                                                copy_counts;
+        std::vector<uint8_t>                                                 open_in;
+        std::vector<uint8_t>                                                 open_out;
+
+    public:
+        uint32_t TriangleCount() const noexcept
+        {
+            return uint32_t(triangles.size() / 3);
+        }
+
+        float Error() const noexcept
+        {
+            return float(std::sqrt(max_error));
+        }
+
+        void Begin(Range<uint32_t> indices, Range<glm::vec3> _positions)
+        {
+            positions = _positions;
+            vertex_count = uint32_t(positions.count);
+            max_error = 0.0;
+
+            triangles.assign(indices.begin, indices.begin + (indices.count - indices.count % 3));
+
+            remap.resize(vertex_count);
+            std::iota(remap.begin(), remap.end(), 0u);
+
+            // Weld by position, vertices with more than one attribute set are seams
+
+            unique_positions.clear();
+            unique_positions.reserve(vertex_count);
+            canonical.resize(vertex_count);
+            locked.assign(vertex_count, 0);
+
+            partner.assign(vertex_count, Invalid);
+            copy_counts.assign(vertex_count, 0);
+
+            for (uint32_t v = 0; v < vertex_count; ++v) {
+                auto[iter, inserted] = unique_positions.insert({ PositionKey { positions[v] }, v });
+                canonical[v] = iter->second;
+                if (!inserted) {
+                    partner[v] = iter->second;
+                    partner[iter->second] = v;
+                }
+                copy_counts[iter->second]++;
+            }
+
+            // Lock border vertices, any welded edge without an opposing edge
+
+            auto edge_key = [](uint32_t a, uint32_t b) {
+                return (uint64_t(a) << 32) | b;
+            };
+
+            edges.clear();
+            edges.reserve(triangles.size());
+            for (uint32_t j = 0; j < triangles.size(); j += 3) {
+                for (uint32_t k = 0; k < 3; ++k) {
+                    edges.insert(edge_key(canonical[triangles[j + k]], canonical[triangles[j + (k + 1) % 3]]));
+                }
+            }
+
+            for (uint32_t j = 0; j < triangles.size(); j += 3) {
+                for (uint32_t k = 0; k < 3; ++k) {
+                    uint32_t a = canonical[triangles[j + k]];
+                    uint32_t b = canonical[triangles[j + (k + 1) % 3]];
+                    if (!edges.contains(edge_key(b, a))) {
+                        locked[a] = 1;
+                        locked[b] = 1;
+                    }
+                }
+            }
+
+            // Seam edges are open between vertices but closed once welded. A seam vertex is
+            //  movable when each of its two copies has exactly one seam edge in and one out,
+            //  anything else is a seam junction or a non-manifold point.
+
+            vertex_edges.clear();
+            vertex_edges.reserve(triangles.size());
+            for (uint32_t j = 0; j < triangles.size(); j += 3) {
+                for (uint32_t k = 0; k < 3; ++k) {
+                    vertex_edges.insert(edge_key(triangles[j + k], triangles[j + (k + 1) % 3]));
+                }
+            }
+
+            open_in.assign(vertex_count, 0);
+            open_out.assign(vertex_count, 0);
+            for (uint32_t j = 0; j < triangles.size(); j += 3) {
+                for (uint32_t k = 0; k < 3; ++k) {
+                    uint32_t a = triangles[j + k];
+                    uint32_t b = triangles[j + (k + 1) % 3];
+                    if (!vertex_edges.contains(edge_key(b, a))) {
+                        open_out[a] = uint8_t(std::min(open_out[a] + 1, 2));
+                        open_in[b] = uint8_t(std::min(open_in[b] + 1, 2));
+                    }
+                }
+            }
+
+            for (uint32_t v = 0; v < vertex_count; ++v) {
+                uint32_t c = canonical[v];
+                if (copy_counts[c] > 2) {
+                    locked[c] = 1;
+                } else if (copy_counts[c] == 2 && (open_in[v] != 1 || open_out[v] != 1)) {
+                    locked[c] = 1;
+                }
+            }
+            for (uint32_t v = 0; v < vertex_count; ++v) {
+                locked[v] = locked[canonical[v]];
+            }
+
+            // Seed welded vertex quadrics from the planes of adjacent triangles
+
+            quadrics.assign(vertex_count, Quadric {});
+            for (uint32_t j = 0; j < triangles.size(); j += 3) {
+                auto p0 = positions[triangles[j + 0]];
+                auto normal = glm::cross(positions[triangles[j + 1]] - p0, positions[triangles[j + 2]] - p0);
+                float length = glm::length(normal);
+                if (length == 0.f) {
+                    continue;
+                }
+                normal /= length;
+
+                auto quadric = Quadric::FromPlane(normal, -glm::dot(normal, p0), length * 0.5);
+                for (uint32_t k = 0; k < 3; ++k) {
+                    quadrics[canonical[triangles[j + k]]] += quadric;
+                }
+
+                // Seam edges add a plane through the edge perpendicular to the face, keeping
+                //  collapses along a seam from pulling it off its original line
+
+                for (uint32_t k = 0; k < 3; ++k) {
+                    uint32_t a = triangles[j + k];
+                    uint32_t b = triangles[j + (k + 1) % 3];
+                    if (vertex_edges.contains(edge_key(b, a)) || !edges.contains(edge_key(canonical[b], canonical[a]))) {
+                        continue;
+                    }
+
+                    auto edge = positions[b] - positions[a];
+                    auto edge_normal = glm::cross(edge, normal);
+                    float edge_length = glm::length(edge_normal);
+                    if (edge_length == 0.f) {
+                        continue;
+                    }
+                    edge_normal /= edge_length;
+
+                    auto edge_quadric = Quadric::FromPlane(edge_normal, -glm::dot(edge_normal, positions[a]), edge_length * edge_length);
+                    quadrics[canonical[a]] += edge_quadric;
+                    quadrics[canonical[b]] += edge_quadric;
+                }
+            }
+        }
+
+        // Simplify until at most target_count triangles remain or no valid collapse is left.
+        //  Can be called repeatedly with decreasing targets to build a chain of levels.
+
+        void Simplify(uint32_t target_count)
+        {
+            while (TriangleCount() > target_count) {
+                if (!CollapsePass(TriangleCount() - target_count)) {
+                    break;
+                }
+            }
+        }
+
+    private:
+        // An edge used by a single triangle on one side of a seam
+
+        bool IsSeamEdge(uint32_t v, uint32_t target) const
+        {
+            uint32_t count = 0;
+            for (uint32_t triangle : adjacency[v]) {
+                const uint32_t* tri = &triangles[triangle * 3];
+                count += tri[0] == target || tri[1] == target || tri[2] == target;
+            }
+            return count == 1;
+        }
+
+        // The copy of target that the other copy of seam vertex v collapses onto
+
+        uint32_t FindSeamTarget(uint32_t v, uint32_t target) const
+        {
+            uint32_t other = partner[v];
+            for (uint32_t triangle : adjacency[other]) {
+                const uint32_t* tri = &triangles[triangle * 3];
+                for (uint32_t k = 0; k < 3; ++k) {
+                    if (canonical[tri[k]] == canonical[target] && IsSeamEdge(other, tri[k])) {
+                        return tri[k];
+                    }
+                }
+            }
+            return Invalid;
+        }
+
+        void LockOneRing(uint32_t v)
+        {
+            pass_locked[v] = 1;
+            for (uint32_t triangle : adjacency[v]) {
+                const uint32_t* tri = &triangles[triangle * 3];
+                for (uint32_t k = 0; k < 3; ++k) {
+                    pass_locked[tri[k]] = 1;
+                }
+            }
+        }
+
+        uint32_t CountCollapsedTriangles(uint32_t v, uint32_t target) const
+        {
+            uint32_t count = 0;
+            for (uint32_t triangle : adjacency[v]) {
+                const uint32_t* tri = &triangles[triangle * 3];
+                count += canonical[tri[0]] == canonical[target] || canonical[tri[1]] == canonical[target] || canonical[tri[2]] == canonical[target];
+            }
+            return count;
+        }
+
+        bool Flips(uint32_t v, uint32_t target) const
+        {
+            for (uint32_t triangle : adjacency[v]) {
+                const uint32_t* tri = &triangles[triangle * 3];
+                if (canonical[tri[0]] == canonical[target] || canonical[tri[1]] == canonical[target] || canonical[tri[2]] == canonical[target]) {
+                    continue;
+                }
+
+                glm::vec3 p[3], q[3];
+                for (uint32_t k = 0; k < 3; ++k) {
+                    p[k] = positions[tri[k]];
+                    q[k] = tri[k] == v ? positions[target] : p[k];
+                }
+
+                auto before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                auto after = glm::cross(q[1] - q[0], q[2] - q[0]);
+                if (glm::dot(before, after) <= 0.25f * glm::length(before) * glm::length(after)) {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        bool CollapsePass(uint32_t budget)
+        {
+            adjacency.Build({ triangles.data(), triangles.size() }, vertex_count);
+
+            // Cheapest collapse for each movable vertex
+
+            best_cost.assign(vertex_count, FLT_MAX);
+            best_target.assign(vertex_count, Invalid);
+
+            for (uint32_t j = 0; j < triangles.size(); j += 3) {
+                for (uint32_t k = 0; k < 3; ++k) {
+                    uint32_t v = triangles[j + k];
+                    if (locked[v]) {
+                        continue;
+                    }
+
+                    for (uint32_t o = 1; o < 3; ++o) {
+                        uint32_t target = triangles[j + (k + o) % 3];
+                        if (canonical[target] == canonical[v]) {
+                            continue;
+                        }
+
+                        // Seam vertices only move along their seam
+
+                        if (partner[v] != Invalid && !IsSeamEdge(v, target)) {
+                            continue;
+                        }
+
+                        Quadric quadric = quadrics[canonical[v]];
+                        quadric += quadrics[canonical[target]];
+                        float cost = float(quadric.Evaluate(positions[target]));
+                        if (cost < best_cost[v]) {
+                            best_cost[v] = cost;
+                            best_target[v] = target;
+                        }
+                    }
+                }
+            }
+
+            order.clear();
+            for (uint32_t v = 0; v < vertex_count; ++v) {
+                if (best_target[v] != Invalid) {
+                    order.push_back(v);
+                }
+            }
+            std::ranges::sort(order, [&](uint32_t l, uint32_t r) {
+                return best_cost[l] != best_cost[r] ? best_cost[l] < best_cost[r] : l < r;
+            });
+
+            // Apply independent collapses in cost order
+
+            pass_locked.assign(vertex_count, 0);
+            uint32_t removed = 0;
+            uint32_t collapsed = 0;
+
+            for (uint32_t v : order) {
+                if (removed >= budget) {
+                    break;
+                }
+
+                uint32_t target = best_target[v];
+                if (pass_locked[v] || pass_locked[target] || Flips(v, target)) {
+                    continue;
+                }
+
+                // Both copies of a seam vertex collapse together onto the matching copies of target
+
+                uint32_t other = partner[v];
+                uint32_t other_target = Invalid;
+                if (other != Invalid) {
+                    other_target = FindSeamTarget(v, target);
+                    if (other_target == Invalid || pass_locked[other] || pass_locked[other_target] || Flips(other, other_target)) {
+                        continue;
+                    }
+                }
+
+                remap[v] = target;
+                removed += CountCollapsedTriangles(v, target);
+                LockOneRing(v);
+                pass_locked[target] = 1;
+
+                if (other != Invalid) {
+                    remap[other] = other_target;
+                    removed += CountCollapsedTriangles(other, other_target);
+                    LockOneRing(other);
+                    pass_locked[other_target] = 1;
+                }
+
+                quadrics[canonical[target]] += quadrics[canonical[v]];
+                max_error = std::max(max_error, double(best_cost[v]));
+                collapsed++;
+            }
+
+            if (!collapsed) {
+                return false;
+            }
+
+            // Remap and drop degenerate triangles
+
+            uint32_t write = 0;
+            for (uint32_t j = 0; j < triangles.size(); j += 3) {
+                uint32_t a = remap[triangles[j + 0]];
+                uint32_t b = remap[triangles[j + 1]];
+                uint32_t c = remap[triangles[j + 2]];
+                if (canonical[a] == canonical[b] || canonical[b] == canonical[c] || canonical[c] == canonical[a]) {
+                    continue;
+                }
+                triangles[write++] = a;
+                triangles[write++] = b;
+                triangles[write++] = c;
+            }
+            triangles.resize(write);
+
+            return true;
+        }
+    };
+
+    // LOD chain for a single geometry range, first index relative to the indices here
+
+    struct LodSet
+    {
+        std::vector<GeometryLod> lods;
+        std::vector<uint32_t>    indices;
+    };
+
+    inline
+    void GenerateLods(Importer& importer, Scene& scene)
+    {
+        auto& memory_pool = importer.memory_pool;
+        auto& settings = importer.settings;
+        auto& ranges = scene.geometry_ranges;
+
+        if (settings.lod_triangle_ratio <= 0.f || settings.lod_triangle_ratio >= 1.f) {
+            Error("Invalid LOD triangle ratio: {}", settings.lod_triangle_ratio);
+        }
+
+        using namespace std::chrono;
+        auto start = steady_clock::now();
+
+        std::vector<LodSet> sets(ranges.count);
+
+#pragma omp parallel
+        {
+            MeshSimplifier simplifier;
+            VertexCacheOptimizer optimizer { .cache_size = settings.vertex_cache_size };
+
+#pragma omp for schedule(dynamic)
+            for (uint32_t i = 0; i < ranges.count; ++i) {
+                auto& range = ranges[i];
+                auto& geometry = scene.geometries[range.geometry_idx];
+                auto& set = sets[i];
+                uint32_t vertex_count = range.max_vertex + 1;
+
+                simplifier.Begin(
+                    geometry.indices.Slice(range.first_index, range.triangle_count * 3),
+                    geometry.positions.Slice(range.vertex_offset, vertex_count));
+
+                double ratio = 1.0;
+                uint32_t previous_count = simplifier.TriangleCount();
+                for (uint32_t level = 0; level < settings.lod_count; ++level) {
+                    ratio *= settings.lod_triangle_ratio;
+                    simplifier.Simplify(uint32_t(double(range.triangle_count) * ratio));
+
+                    // Stop once the simplifier can make no further progress
+
+                    uint32_t triangle_count = simplifier.TriangleCount();
+                    if (triangle_count == previous_count || triangle_count == 0) {
+                        break;
+                    }
+                    previous_count = triangle_count;
+
+                    uint32_t first_index = uint32_t(set.indices.size());
+                    set.indices.insert(set.indices.end(), simplifier.triangles.begin(), simplifier.triangles.end());
+                    set.lods.push_back(GeometryLod {
+                        .first_index = first_index,
+                        .triangle_count = triangle_count,
+                        .error = simplifier.Error(),
+                    });
+
+                    if (settings.optimize_vertex_cache) {
+                        optimizer.OptimizeIndices({ set.indices.data() + first_index, triangle_count * 3 }, vertex_count);
+                    }
+                }
+            }
+        }
+
+        // Flatten into scene ranges, per geometry page
+
+        uint64_t total_lod_count = 0;
+        uint64_t total_lod_index_count = 0;
+
+        std::vector<uint32_t> index_bases(ranges.count);
+
+        for (uint32_t p = 0; p < scene.geometries.count; ++p) {
+            auto& geometry = scene.geometries[p];
+
+            uint64_t lod_count = 0;
+            uint64_t lod_index_count = 0;
+            for (uint32_t i = geometry.first_range; i < geometry.first_range + geometry.range_count; ++i) {
+                index_bases[i] = uint32_t(lod_index_count);
+                ranges[i].first_lod = uint32_t(lod_count);
+                ranges[i].lod_count = uint32_t(sets[i].lods.size());
+                lod_count += sets[i].lods.size();
+                lod_index_count += sets[i].indices.size();
+            }
+
+            if (lod_index_count > UINT32_MAX) {
+                Error("LOD indices exceed 32 bit offsets in a geometry page, reduce the geometry page size");
+            }
+
+            geometry.lods        = { memory_pool.Allocate<GeometryLod>(lod_count),    lod_count       };
+            geometry.lod_indices = { memory_pool.Allocate<uint32_t>(lod_index_count), lod_index_count };
+
+            total_lod_count += lod_count;
+            total_lod_index_count += lod_index_count;
+        }
+
+#pragma omp parallel for schedule(dynamic)
+        for (uint32_t i = 0; i < ranges.count; ++i) {
+            auto& geometry = scene.geometries[ranges[i].geometry_idx];
+            auto& set = sets[i];
+
+            for (uint32_t j = 0; j < set.lods.size(); ++j) {
+                auto lod = set.lods[j];
+                lod.first_index += index_bases[i];
+                geometry.lods[ranges[i].first_lod + j] = lod;
+            }
+
+            std::ranges::copy(set.indices, &geometry.lod_indices[index_bases[i]]);
+        }
+
+        auto end = steady_clock::now();
+
+        uint64_t base_triangle_count = 0;
+        for (uint32_t i = 0; i < ranges.count; ++i) {
+            base_triangle_count += ranges[i].triangle_count;
+        }
+
+        fmt::println("Generated {} LODs ({} triangles over {} base triangles) in {} ms",
+            total_lod_count, total_lod_index_count / 3, base_triangle_count,
+            duration_cast<milliseconds>(end - start).count());
+    }
+}
@@ -1,11 +1,17 @@
 #include "imp_ImageProcess.hpp"
+#include "imp_ImageResample.hpp"
+#include "imp_TextureCompression.hpp"
 
 #include <bc7enc.h>
 
 namespace imp
 {
-    void Process(std::span<ImageProcessInput> inputs, ImageProcessFlags flags, ImageView& output)
+    void Process(std::span<ImageProcessInput> inputs, ImageProcessFlags flags, ImageView& output, ImageFilter filter)
     {
+        if (inputs.empty() || inputs.size() > 4) {
+            throw std::runtime_error("Between 1 and 4 inputs are supported");
+        }
+
         for (uint32_t i = 1; i < inputs.size(); ++i) {
             if (inputs.begin()[i - 1].buffer.size != inputs.begin()[i].buffer.size) {
                 throw std::runtime_error("Mismatched input sizes, not supported currently");
@@ -16,6 +22,67 @@ namespace imp
             throw std::runtime_error("Mismatched input/output size");
         }
 
+        if (detail::IsBlockCompressed(output.format)) {
+            throw std::runtime_error("Block compressed output is not supported, compress after processing");
+        }
+
+        if (detail::IsFloatFormat(output.format)) {
+            throw std::runtime_error("Float output is not supported");
+        }
+
+        uint32_t channels = detail::GetChannelCount(output.format);
+        uint32_t mip_count = (flags & ImageProcessFlags::GenMipMaps) ? detail::GetMipCount(output.size) : 1;
+
+        if (output.bytes.count < detail::GetMipChainBytes(output.size, mip_count, channels)) {
+            throw std::runtime_error("Output buffer too small");
+        }
+
+        // Merge inputs as a texture process over the input buffers
+
+        InMaterial::TextureProcess process { .format = output.format };
+        std::array<detail::ChannelSource, 4> sources;
+
+        for (uint32_t c = 0; c < 4; ++c) {
+            process.channels[c] = InMaterial::ChannelOp {
+                .input = InMaterial::ChannelOp::Constant,
+                .value = c == 3 ? 1.f : 0.f,
+            };
+        }
 
+        for (uint32_t i = 0; i < inputs.size(); ++i) {
+            auto& buffer = inputs[i].buffer;
+            if (detail::IsBlockCompressed(buffer.format) || detail::IsFloatFormat(buffer.format)) {
+                throw std::runtime_error("Block compressed and float inputs are not supported");
+            }
+            uint32_t input_channels = detail::GetChannelCount(buffer.format);
+            if (buffer.bytes.count < uint64_t(buffer.size.x) * buffer.size.y * input_channels) {
+                throw std::runtime_error("Input buffer too small");
+            }
+
+            sources[i] = { reinterpret_cast<const uint8_t*>(buffer.bytes.begin), buffer.size, input_channels };
+
+            for (uint32_t c = 0; c < 4; ++c) {
+                int8_t swizzle = inputs[i].swizzles[c];
+                if (swizzle < 0) {
+                    continue;
+                }
+                if (uint32_t(swizzle) >= input_channels) {
+                    throw std::runtime_error("Swizzle references a channel missing from its input");
+                }
+                process.channels[c] = InMaterial::ChannelOp { .input = int8_t(i), .channel = uint8_t(swizzle) };
+            }
+        }
+
+        auto* out = reinterpret_cast<uint8_t*>(output.bytes.begin);
+
+        detail::ChannelKernel kernel;
+        if (!kernel.Compile(process, std::span(sources.data(), inputs.size()), output.size)) {
+            throw std::runtime_error("Invalid inputs");
+        }
+        kernel.RunRows(output.size, out, true);
+
+        if (mip_count > 1) {
+            detail::GenerateMips(out, output.size, channels, filter, output.format == TextureFormat::RGBA8_SRGB, true);
+        }
     }
-}
\ No newline at end of file
+}
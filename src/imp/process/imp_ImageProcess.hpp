@@ -13,6 +13,9 @@ namespace imp
         TextureFormat    format;
     };
 
+    // Each non negative swizzle selects the input channel written to that output channel.
+    //  Output channels not written by any input are 0, or 1 for alpha.
+
     struct ImageProcessInput
     {
         ImageView             buffer;
@@ -21,8 +24,41 @@ namespace imp
 
     enum class ImageProcessFlags
     {
-        GenMipMaps,
+        None = 0,
+
+        // Output holds the full mip chain, levels tightly packed largest first
+
+        GenMipMaps = 1 << 0,
+    };
+
+    constexpr ImageProcessFlags operator|(ImageProcessFlags l, ImageProcessFlags r)
+    {
+        return ImageProcessFlags(uint32_t(l) | uint32_t(r));
+    }
+
+    constexpr bool operator&(ImageProcessFlags l, ImageProcessFlags r)
+    {
+        return uint32_t(l) & uint32_t(r);
+    }
+
+    // Resampling filter kernel. sRGB data is always filtered in linear space.
+
+    enum class ImageFilter
+    {
+        Box,
+        Triangle,
+        Kaiser,
+        Lanczos3,
+    };
+
+    // Block compression speed / quality trade off
+
+    enum class TextureCompressionQuality
+    {
+        Fast,
+        Normal,
+        Best,
     };
 
-    void Process(std::span<ImageProcessInput> inputs, ImageProcessFlags flags, ImageView& output);
-}
\ No newline at end of file
+    void Process(std::span<ImageProcessInput> inputs, ImageProcessFlags flags, ImageView& output, ImageFilter filter = ImageFilter::Box);
+}
@@ -0,0 +1,352 @@
+#pragma once
+
+#include "imp_ImageProcess.hpp"
+#include "imp_ChannelKernels.hpp"
+
+#include <numbers>
+
+namespace imp::detail
+{
+    inline
+    float FilterSupport(ImageFilter filter) noexcept
+    {
+        switch (filter) {
+            break;case ImageFilter::Box:      return 0.5f;
+            break;case ImageFilter::Triangle: return 1.f;
+            break;case ImageFilter::Kaiser:   return 3.f;
+            break;case ImageFilter::Lanczos3: return 3.f;
+        }
+        std::unreachable();
+    }
+
+    inline
+    float Sinc(float x) noexcept
+    {
+        if (std::abs(x) < 1e-5f) {
+            return 1.f;
+        }
+        x *= std::numbers::pi_v<float>;
+        return std::sin(x) / x;
+    }
+
+    // Zeroth order modified Bessel function of the first kind
+
+    inline
+    float BesselI0(float x) noexcept
+    {
+        float sum = 1.f;
+        float term = 1.f;
+        for (uint32_t k = 1; k < 32; ++k) {
+            float t = x / (2.f * float(k));
+            term *= t * t;
+            sum += term;
+            if (term < sum * 1e-8f) {
+                break;
+            }
+        }
+        return sum;
+    }
+
+    inline
+    float EvaluateFilter(ImageFilter filter, float x) noexcept
+    {
+        x = std::abs(x);
+        switch (filter) {
+            break;case ImageFilter::Box:
+                return x < 0.5f ? 1.f : 0.f;
+            break;case ImageFilter::Triangle:
+                return std::max(1.f - x, 0.f);
+            break;case ImageFilter::Kaiser: {
+                constexpr float Alpha = 4.f;
+                constexpr float Width = 3.f;
+                if (x >= Width) {
+                    return 0.f;
+                }
+                float t = x / Width;
+                return Sinc(x) * BesselI0(Alpha * std::sqrt(1.f - t * t)) / BesselI0(Alpha);
+            }
+            break;case ImageFilter::Lanczos3:
+                return x < 3.f ? Sinc(x) * Sinc(x / 3.f) : 0.f;
+        }
+        std::unreachable();
+    }
+
+    // Normalized filter taps for each output pixel along one axis. Minification widens the
+    //  filter by the scale factor, taps outside the image are clamped to the edge.
+
+    inline
+    uint32_t GetFilterTapCount(uint32_t src, uint32_t dst, ImageFilter filter) noexcept
+    {
+        float scale = std::max(float(src) / float(dst), 1.f);
+        return uint32_t(std::ceil(FilterSupport(filter) * scale * 2.f)) + 1;
+    }
+
+    struct FilterTaps
+    {
+        uint32_t              max_taps = 0;
+        std::vector<uint32_t> indices;
+        std::vector<float>    weights;
+
+    public:
+        void Build(uint32_t src, uint32_t dst, ImageFilter filter)
+        {
+            float ratio = float(src) / float(dst);
+            float scale = std::max(ratio, 1.f);
+            float support = FilterSupport(filter) * scale;
+
+            max_taps = GetFilterTapCount(src, dst, filter);
+            indices.assign(uint64_t(dst) * max_taps, 0);
+            weights.assign(uint64_t(dst) * max_taps, 0.f);
+
+            for (uint32_t x = 0; x < dst; ++x) {
+                float center = (float(x) + 0.5f) * ratio;
+                int32_t first = int32_t(std::floor(center - support));
+
+                float sum = 0.f;
+                for (uint32_t k = 0; k < max_taps; ++k) {
+                    int32_t i = first + int32_t(k);
+                    float weight = EvaluateFilter(filter, (float(i) + 0.5f - center) / scale);
+                    indices[x * max_taps + k] = uint32_t(std::clamp(i, 0, int32_t(src) - 1));
+                    weights[x * max_taps + k] = weight;
+                    sum += weight;
+                }
+
+                if (sum == 0.f) {
+                    indices[x * max_taps] = std::min(uint32_t(center), src - 1);
+                    weights[x * max_taps] = 1.f;
+                    continue;
+                }
+
+                for (uint32_t k = 0; k < max_taps; ++k) {
+                    weights[x * max_taps + k] /= sum;
+                }
+            }
+        }
+    };
+
+    // Lookup tables for filtering sRGB data in linear space. Encoding is exact: a coarse table
+    //  gives a lower bound code which is advanced past the linear midpoints between codes.
+
+    struct SrgbTables
+    {
+        static constexpr uint32_t CoarseSize = 4096;
+
+        std::array<float, 256>              to_linear;
+        std::array<float, 256>              midpoints;
+        std::array<uint8_t, CoarseSize + 1> coarse;
+
+    public:
+        SrgbTables()
+        {
+            for (uint32_t k = 0; k < 256; ++k) {
+                to_linear[k] = SrgbToLinear(float(k) / 255.f);
+                midpoints[k] = k < 255 ? SrgbToLinear((float(k) + 0.5f) / 255.f) : INFINITY;
+            }
+
+            uint32_t code = 0;
+            for (uint32_t j = 0; j <= CoarseSize; ++j) {
+                while (float(j) / float(CoarseSize) >= midpoints[code]) {
+                    code++;
+                }
+                coarse[j] = uint8_t(code);
+            }
+        }
+
+        uint8_t Encode(float v) const noexcept
+        {
+            v = v > 0.f ? std::min(v, 1.f) : 0.f;
+            uint32_t code = coarse[uint32_t(v * float(CoarseSize))];
+            while (v >= midpoints[code]) {
+                code++;
+            }
+            return uint8_t(code);
+        }
+
+        static const SrgbTables& Get()
+        {
+            static SrgbTables tables;
+            return tables;
+        }
+    };
+
+    // Separable resampling of 8 bit or float interleaved images. Each thread walks a run of
+    //  output rows, keeping the last taps_y.max_taps source rows it filtered horizontally in a
+    //  ring, so the float working set is a few rows per thread rather than a whole image.
+    //  sRGB color channels are filtered in linear space, alpha, UNORM and float data as is.
+
+    template<class T, uint32_t Channels>
+    void ResampleImage(const T* src, glm::uvec2 src_size, T* dst, glm::uvec2 dst_size, ImageFilter filter, bool srgb, bool parallel)
+    {
+        static_assert(std::is_same_v<T, uint8_t> || std::is_same_v<T, float>);
+
+        auto& tables = SrgbTables::Get();
+
+        auto is_srgb = [&](uint32_t c) {
+            return srgb && c < 3;
+        };
+
+        std::array<std::array<float, 256>, Channels> to_float;
+        for (uint32_t c = 0; c < Channels; ++c) {
+            for (uint32_t k = 0; k < 256; ++k) {
+                to_float[c][k] = is_srgb(c) ? tables.to_linear[k] : float(k) / 255.f;
+            }
+        }
+
+        FilterTaps taps_x, taps_y;
+        taps_x.Build(src_size.x, dst_size.x, filter);
+        taps_y.Build(src_size.y, dst_size.y, filter);
+
+        uint64_t row_floats = uint64_t(dst_size.x) * Channels;
+
+        // Tap rows of one output row span at most max_taps consecutive source rows, so indexing
+        //  the ring by source row modulo its size never evicts a row that is still needed
+
+        uint32_t ring_size = taps_y.max_taps;
+
+#pragma omp parallel if(parallel)
+        {
+            std::vector<float> row(uint64_t(src_size.x) * Channels);
+            std::vector<float> ring(ring_size * row_floats);
+            std::vector<uint32_t> ring_rows(ring_size, UINT32_MAX);
+            std::vector<float> accum(row_floats);
+
+            auto filter_row = [&](uint32_t y) -> const float* {
+                float* out = &ring[(y % ring_size) * row_floats];
+                if (ring_rows[y % ring_size] == y) {
+                    return out;
+                }
+                ring_rows[y % ring_size] = y;
+
+                const T* in = src + uint64_t(y) * src_size.x * Channels;
+                for (uint32_t x = 0; x < src_size.x; ++x) {
+                    for (uint32_t c = 0; c < Channels; ++c) {
+                        if constexpr (std::is_same_v<T, float>) {
+                            row[x * Channels + c] = in[x * Channels + c];
+                        } else {
+                            row[x * Channels + c] = to_float[c][in[x * Channels + c]];
+                        }
+                    }
+                }
+
+                for (uint32_t x = 0; x < dst_size.x; ++x) {
+                    std::array<float, Channels> sum = {};
+                    for (uint32_t k = 0; k < taps_x.max_taps; ++k) {
+                        float weight = taps_x.weights[x * taps_x.max_taps + k];
+                        const float* texel = &row[taps_x.indices[x * taps_x.max_taps + k] * Channels];
+#pragma omp simd
+                        for (uint32_t c = 0; c < Channels; ++c) {
+                            sum[c] += weight * texel[c];
+                        }
+                    }
+                    for (uint32_t c = 0; c < Channels; ++c) {
+                        out[x * Channels + c] = sum[c];
+                    }
+                }
+                return out;
+            };
+
+            // Runs of consecutive output rows share most of their source rows
+
+#pragma omp for schedule(dynamic, 64)
+            for (uint32_t y = 0; y < dst_size.y; ++y) {
+                std::fill(accum.begin(), accum.end(), 0.f);
+                for (uint32_t k = 0; k < taps_y.max_taps; ++k) {
+                    float weight = taps_y.weights[y * taps_y.max_taps + k];
+                    if (weight == 0.f) {
+                        continue;
+                    }
+                    const float* in = filter_row(taps_y.indices[y * taps_y.max_taps + k]);
+                    float* out = accum.data();
+#pragma omp simd
+                    for (uint64_t i = 0; i < row_floats; ++i) {
+                        out[i] += weight * in[i];
+                    }
+                }
+
+                T* out = dst + uint64_t(y) * dst_size.x * Channels;
+                for (uint32_t x = 0; x < dst_size.x; ++x) {
+                    for (uint32_t c = 0; c < Channels; ++c) {
+                        float v = accum[x * Channels + c];
+                        if constexpr (std::is_same_v<T, float>) {
+                            out[x * Channels + c] = v;
+                        } else {
+                            out[x * Channels + c] = is_srgb(c) ? tables.Encode(v) : QuantizeUNorm8(v);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // Bytes allocated by ResampleImage running on the given number of threads: filter taps, and
+    //  per thread a source row, the ring of filtered rows and the accumulator row
+
+    inline
+    uint64_t GetResampleWorkingBytes(glm::uvec2 src_size, glm::uvec2 dst_size, uint32_t channels, ImageFilter filter, uint32_t threads) noexcept
+    {
+        uint32_t taps_x = GetFilterTapCount(src_size.x, dst_size.x, filter);
+        uint32_t taps_y = GetFilterTapCount(src_size.y, dst_size.y, filter);
+        uint64_t tap_bytes = (uint64_t(dst_size.x) * taps_x + uint64_t(dst_size.y) * taps_y) * (sizeof(uint32_t) + sizeof(float));
+        uint64_t thread_floats = (uint64_t(src_size.x) + uint64_t(taps_y + 1) * dst_size.x) * channels;
+        return tap_bytes + threads * (thread_floats * sizeof(float) + taps_y * sizeof(uint32_t));
+    }
+
+    template<class T>
+    void ResampleImage(const T* src, glm::uvec2 src_size, T* dst, glm::uvec2 dst_size, uint32_t channels, ImageFilter filter, bool srgb, bool parallel)
+    {
+        switch (channels) {
+            break;case 1: ResampleImage<T, 1>(src, src_size, dst, dst_size, filter, srgb, parallel);
+            break;case 2: ResampleImage<T, 2>(src, src_size, dst, dst_size, filter, srgb, parallel);
+            break;case 4: ResampleImage<T, 4>(src, src_size, dst, dst_size, filter, srgb, parallel);
+        }
+    }
+
+    // Mip levels are stored tightly packed, largest first, each level halving (rounding down)
+    //  the previous one down to 1x1
+
+    inline
+    uint32_t GetMipCount(glm::uvec2 size) noexcept
+    {
+        return size.x && size.y ? uint32_t(std::bit_width(std::max(size.x, size.y))) : 0;
+    }
+
+    inline
+    glm::uvec2 GetMipSize(glm::uvec2 size, uint32_t level) noexcept
+    {
+        return { std::max(size.x >> level, 1u), std::max(size.y >> level, 1u) };
+    }
+
+    inline
+    uint64_t GetMipChainBytes(glm::uvec2 size, uint32_t mip_count, uint32_t pixel_bytes) noexcept
+    {
+        uint64_t bytes = 0;
+        for (uint32_t level = 0; level < mip_count; ++level) {
+            auto mip_size = GetMipSize(size, level);
+            bytes += uint64_t(mip_size.x) * mip_size.y * pixel_bytes;
+        }
+        return bytes;
+    }
+
+    // Largest resampler working set of GenerateMips, the first level is the widest
+
+    inline
+    uint64_t GetMipWorkingBytes(glm::uvec2 size, uint32_t channels, ImageFilter filter, uint32_t threads) noexcept
+    {
+        return GetMipCount(size) > 1 ? GetResampleWorkingBytes(size, GetMipSize(size, 1), channels, filter, threads) : 0;
+    }
+
+    // Fills levels 1.. of a mip chain from level 0, each level filtered from the previous one
+
+    template<class T>
+    void GenerateMips(T* data, glm::uvec2 size, uint32_t channels, ImageFilter filter, bool srgb, bool parallel)
+    {
+        uint32_t mip_count = GetMipCount(size);
+        for (uint32_t level = 1; level < mip_count; ++level) {
+            auto src_size = GetMipSize(size, level - 1);
+            auto dst_size = GetMipSize(size, level);
+            T* dst = data + uint64_t(src_size.x) * src_size.y * channels;
+            ResampleImage(data, src_size, dst, dst_size, channels, filter, srgb, parallel);
+            data = dst;
+        }
+    }
+}
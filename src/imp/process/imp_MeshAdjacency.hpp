@@ -0,0 +1,42 @@
+#pragma once
+
+#include <imp/imp_Core.hpp>
+
+#include <span>
+
+namespace imp::detail
+{
+    // Vertex -> triangle adjacency in compressed (CSR) form. Triangles adjacent to each
+    //  vertex are stored in index order, once per reference.
+
+    struct VertexTriangleAdjacency
+    {
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> triangles;
+
+    public:
+        void Build(Range<const uint32_t> indices, uint32_t vertex_count)
+        {
+            uint32_t index_count = uint32_t(indices.count - indices.count % 3);
+
+            offsets.assign(vertex_count + 1, 0);
+            for (uint32_t j = 0; j < index_count; ++j) {
+                offsets[indices[j] + 1]++;
+            }
+            for (uint32_t v = 0; v < vertex_count; ++v) {
+                offsets[v + 1] += offsets[v];
+            }
+
+            triangles.resize(index_count);
+            std::vector<uint32_t> cursors(offsets.begin(), offsets.end() - 1);
+            for (uint32_t j = 0; j < index_count; ++j) {
+                triangles[cursors[indices[j]]++] = j / 3;
+            }
+        }
+
+        std::span<const uint32_t> operator[](uint32_t vertex) const noexcept
+        {
+            return { triangles.data() + offsets[vertex], triangles.data() + offsets[vertex + 1] };
+        }
+    };
+}
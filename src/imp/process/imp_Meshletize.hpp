@@ -0,0 +1,532 @@
+#pragma once
+
+#include <imp/imp_Importer.hpp>
+
+#include "imp_MeshAdjacency.hpp"
+
+#include <numeric>
+
+namespace imp::detail
+{
+    // Meshlets for a single geometry range. Meshlet offsets index into the vectors here,
+    //  meshlet vertices are range relative.
+
+    struct MeshletSet
+    {
+        std::vector<Meshlet>       meshlets;
+        std::vector<MeshletBounds> bounds;
+        std::vector<uint32_t>      vertices;
+        std::vector<Vec3<uint8_t>> triangles;
+
+        void Clear()
+        {
+            meshlets.clear();
+            bounds.clear();
+            vertices.clear();
+            triangles.clear();
+        }
+    };
+
+    inline
+    MeshletBounds ComputeMeshletBounds(const MeshletSet& set, const Meshlet& meshlet, Range<glm::vec3> positions)
+    {
+        MeshletBounds bounds = {};
+
+        auto vertex = [&](uint32_t local) {
+            return positions[set.vertices[meshlet.vertex_offset + local]];
+        };
+
+        // Bounding sphere (Ritter)
+
+        auto farthest = [&](glm::vec3 from) {
+            glm::vec3 best = from;
+            float best_dist = -1.f;
+            for (uint32_t i = 0; i < meshlet.vertex_count; ++i) {
+                float dist = glm::dot(vertex(i) - from, vertex(i) - from);
+                if (dist > best_dist) {
+                    best_dist = dist;
+                    best = vertex(i);
+                }
+            }
+            return best;
+        };
+
+        glm::vec3 p1 = farthest(vertex(0));
+        glm::vec3 p2 = farthest(p1);
+
+        glm::vec3 center = (p1 + p2) * 0.5f;
+        float radius = glm::length(p2 - p1) * 0.5f;
+
+        for (uint32_t i = 0; i < meshlet.vertex_count; ++i) {
+            float dist = glm::length(vertex(i) - center);
+            if (dist > radius) {
+                float new_radius = (radius + dist) * 0.5f;
+                center += (vertex(i) - center) * ((new_radius - radius) / dist);
+                radius = new_radius;
+            }
+        }
+
+        bounds.center = center;
+        bounds.radius = radius;
+
+        // Normal cone
+
+        bounds.cone_apex = center;
+        bounds.cone_cutoff = 1.f;
+
+        glm::vec3 axis = {};
+        for (uint32_t i = 0; i < meshlet.triangle_count; ++i) {
+            auto& tri = set.triangles[meshlet.triangle_offset + i];
+            auto normal = glm::cross(vertex(tri[1]) - vertex(tri[0]), vertex(tri[2]) - vertex(tri[0]));
+            if (float length = glm::length(normal); length > 0.f) {
+                axis += normal / length;
+            }
+        }
+
+        float axis_length = glm::length(axis);
+        if (axis_length == 0.f) {
+            return bounds;
+        }
+
+        axis /= axis_length;
+        bounds.cone_axis = axis;
+
+        float min_dp = 1.f;
+        for (uint32_t i = 0; i < meshlet.triangle_count; ++i) {
+            auto& tri = set.triangles[meshlet.triangle_offset + i];
+            auto normal = glm::cross(vertex(tri[1]) - vertex(tri[0]), vertex(tri[2]) - vertex(tri[0]));
+            if (float length = glm::length(normal); length > 0.f) {
+                min_dp = std::min(min_dp, glm::dot(normal / length, axis));
+            }
+        }
+
+        // Wide cones can not be usefully culled
+
+        if (min_dp <= 0.1f) {
+            return bounds;
+        }
+
+        // Find the point along the axis behind all triangle planes
+
+        float max_t = 0.f;
+        for (uint32_t i = 0; i < meshlet.triangle_count; ++i) {
+            auto& tri = set.triangles[meshlet.triangle_offset + i];
+            auto normal = glm::cross(vertex(tri[1]) - vertex(tri[0]), vertex(tri[2]) - vertex(tri[0]));
+            if (float length = glm::length(normal); length > 0.f) {
+                normal /= length;
+                float t = glm::dot(center - vertex(tri[0]), normal) / glm::dot(axis, normal);
+                max_t = std::max(max_t, t);
+            }
+        }
+
+        bounds.cone_apex = center - axis * max_t;
+        bounds.cone_cutoff = std::sqrt(1.f - min_dp * min_dp);
+
+        return bounds;
+    }
+
+    // Kd-tree over triangle centroids for nearest unused triangle queries. Removed triangles
+    //  stay in their leaves, subtrees are skipped once all their triangles are removed.
+
+    struct TriangleKdTree
+    {
+        static constexpr uint32_t Invalid = UINT32_MAX;
+        static constexpr uint32_t LeafSize = 8;
+        static constexpr uint32_t LeafAxis = 3;
+
+        // Inner nodes have their left child next in the array and their right child at first
+
+        struct Node
+        {
+            float    split;
+            uint32_t axis;
+            uint32_t first;
+            uint32_t count;
+            uint32_t live;
+            uint32_t parent;
+        };
+
+        std::vector<Node>      nodes;
+        std::vector<uint32_t>  items;
+        std::vector<uint32_t>  leaves;
+        std::vector<glm::vec3> centroids;
+
+    public:
+        void Build(Range<uint32_t> indices, Range<glm::vec3> positions)
+        {
+            uint32_t triangle_count = uint32_t(indices.count / 3);
+
+            centroids.resize(triangle_count);
+            for (uint32_t t = 0; t < triangle_count; ++t) {
+                centroids[t] = (positions[indices[t * 3 + 0]] + positions[indices[t * 3 + 1]] + positions[indices[t * 3 + 2]]) * (1.f / 3.f);
+            }
+
+            items.resize(triangle_count);
+            std::iota(items.begin(), items.end(), 0u);
+            leaves.resize(triangle_count);
+            nodes.clear();
+
+            if (triangle_count) {
+                BuildNode(0, triangle_count, Invalid);
+            }
+        }
+
+        void Remove(uint32_t triangle)
+        {
+            for (uint32_t node = leaves[triangle]; node != Invalid; node = nodes[node].parent) {
+                nodes[node].live--;
+            }
+        }
+
+        // Returns the remaining triangle with its centroid nearest to point, or Invalid
+
+        uint32_t Nearest(glm::vec3 point, const std::vector<uint8_t>& removed) const
+        {
+            uint32_t best = Invalid;
+            float best_dist = FLT_MAX;
+            if (!nodes.empty()) {
+                Nearest(0, point, removed, best, best_dist);
+            }
+            return best;
+        }
+
+    private:
+        uint32_t BuildNode(uint32_t first, uint32_t count, uint32_t parent)
+        {
+            uint32_t node = uint32_t(nodes.size());
+            nodes.push_back(Node { .axis = LeafAxis, .first = first, .count = count, .live = count, .parent = parent });
+
+            if (count <= LeafSize) {
+                for (uint32_t i = first; i < first + count; ++i) {
+                    leaves[items[i]] = node;
+                }
+                return node;
+            }
+
+            // Split at the median of the widest axis
+
+            glm::vec3 min = centroids[items[first]];
+            glm::vec3 max = min;
+            for (uint32_t i = first + 1; i < first + count; ++i) {
+                min = glm::min(min, centroids[items[i]]);
+                max = glm::max(max, centroids[items[i]]);
+            }
+            auto extent = max - min;
+            uint32_t axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+
+            uint32_t half = count / 2;
+            std::nth_element(items.begin() + first, items.begin() + first + half, items.begin() + first + count, [&](uint32_t l, uint32_t r) {
+                return centroids[l][axis] < centroids[r][axis];
+            });
+
+            float split = centroids[items[first + half]][axis];
+            BuildNode(first, half, node);
+            uint32_t right = BuildNode(first + half, count - half, node);
+
+            nodes[node].split = split;
+            nodes[node].axis = axis;
+            nodes[node].first = right;
+            return node;
+        }
+
+        void Nearest(uint32_t node, glm::vec3 point, const std::vector<uint8_t>& removed, uint32_t& best, float& best_dist) const
+        {
+            auto& n = nodes[node];
+            if (!n.live) {
+                return;
+            }
+
+            if (n.axis == LeafAxis) {
+                for (uint32_t i = n.first; i < n.first + n.count; ++i) {
+                    uint32_t triangle = items[i];
+                    if (removed[triangle]) {
+                        continue;
+                    }
+                    auto offset = centroids[triangle] - point;
+                    float dist = glm::dot(offset, offset);
+                    if (dist < best_dist) {
+                        best = triangle;
+                        best_dist = dist;
+                    }
+                }
+                return;
+            }
+
+            float delta = point[n.axis] - n.split;
+            uint32_t near = delta <= 0.f ? node + 1 : n.first;
+            uint32_t far = delta <= 0.f ? n.first : node + 1;
+
+            Nearest(near, point, removed, best, best_dist);
+            if (delta * delta < best_dist) {
+                Nearest(far, point, removed, best, best_dist);
+            }
+        }
+    };
+
+    // Greedy meshlet builder. Triangles are added preferring those that add the fewest new
+    //  vertices, connected to the last added triangle, then to any vertex in the meshlet,
+    //  breaking ties by distance to the meshlet centroid. When nothing connected fits, the
+    //  unused triangle nearest to the centroid is added if it fits before starting a new meshlet.
+
+    struct MeshletBuilder
+    {
+        uint32_t max_vertices;
+        uint32_t max_triangles;
+
+        // Fill meshlets with unconnected triangles, off for clusters that are simplified as
+        //  groups where disjoint clusters lock more of the group border
+
+        bool fill_nearest = true;
+
+        VertexTriangleAdjacency adjacency;
+        TriangleKdTree          tree;
+        std::vector<uint8_t>    emitted;
+        std::vector<uint32_t>   vertex_local;
+
+    public:
+        void Build(Range<uint32_t> indices, Range<glm::vec3> positions, MeshletSet& out)
+        {
+            constexpr uint32_t Invalid = UINT32_MAX;
+
+            uint32_t vertex_count = uint32_t(positions.count);
+            uint32_t triangle_count = uint32_t(indices.count / 3);
+
+            out.Clear();
+            if (!triangle_count) {
+                return;
+            }
+
+            adjacency.Build(indices, vertex_count);
+            if (fill_nearest) {
+                tree.Build(indices, positions);
+            }
+            emitted.assign(triangle_count, 0);
+            vertex_local.assign(vertex_count, Invalid);
+
+            Meshlet current = {};
+            glm::vec3 centroid_sum = {};
+
+            auto triangle_vertices = [&](uint32_t triangle) {
+                return std::array<uint32_t, 3> { indices[triangle * 3 + 0], indices[triangle * 3 + 1], indices[triangle * 3 + 2] };
+            };
+
+            auto new_vertex_count = [&](uint32_t triangle) {
+                auto[a, b, c] = triangle_vertices(triangle);
+                return uint32_t(vertex_local[a] == Invalid)
+                    + uint32_t(vertex_local[b] == Invalid && b != a)
+                    + uint32_t(vertex_local[c] == Invalid && c != a && c != b);
+            };
+
+            auto flush = [&] {
+                if (!current.triangle_count) {
+                    return;
+                }
+                out.bounds.push_back(ComputeMeshletBounds(out, current, positions));
+                out.meshlets.push_back(current);
+                for (uint32_t i = 0; i < current.vertex_count; ++i) {
+                    vertex_local[out.vertices[current.vertex_offset + i]] = Invalid;
+                }
+                current = Meshlet {
+                    .vertex_offset = uint32_t(out.vertices.size()),
+                    .triangle_offset = uint32_t(out.triangles.size()),
+                };
+                centroid_sum = {};
+            };
+
+            auto find_candidate = [&](std::span<const uint32_t> vertices) {
+                uint32_t best = Invalid;
+                uint32_t best_extra = Invalid;
+                float best_dist = FLT_MAX;
+                glm::vec3 centroid = centroid_sum / float(std::max(current.vertex_count, 1u));
+
+                for (uint32_t v : vertices) {
+                    for (uint32_t triangle : adjacency[v]) {
+                        if (emitted[triangle]) {
+                            continue;
+                        }
+
+                        uint32_t extra = new_vertex_count(triangle);
+                        if (current.vertex_count + extra > max_vertices || extra > best_extra) {
+                            continue;
+                        }
+
+                        auto[a, b, c] = triangle_vertices(triangle);
+                        auto offset = (positions[a] + positions[b] + positions[c]) * (1.f / 3.f) - centroid;
+                        float dist = glm::dot(offset, offset);
+
+                        if (extra < best_extra || dist < best_dist) {
+                            best = triangle;
+                            best_extra = extra;
+                            best_dist = dist;
+                        }
+                    }
+                }
+
+                return best;
+            };
+
+            uint32_t last_triangle = Invalid;
+            uint32_t scan = 0;
+
+            for (uint32_t added = 0; added < triangle_count; ++added) {
+                uint32_t triangle = Invalid;
+
+                if (last_triangle != Invalid) {
+                    triangle = find_candidate(triangle_vertices(last_triangle));
+                }
+
+                if (triangle == Invalid && current.vertex_count) {
+                    triangle = find_candidate({ out.vertices.data() + current.vertex_offset, current.vertex_count });
+                }
+
+                // Nothing connected fits, fill up with the nearest unused triangle. Unconnected
+                //  triangles add three vertices, skip the search when those can't fit.
+
+                if (fill_nearest && triangle == Invalid && current.vertex_count && current.vertex_count + 3 <= max_vertices) {
+                    uint32_t nearest = tree.Nearest(centroid_sum / float(current.vertex_count), emitted);
+                    if (nearest != Invalid && current.vertex_count + new_vertex_count(nearest) <= max_vertices) {
+                        triangle = nearest;
+                    }
+                }
+
+                if (triangle == Invalid) {
+
+                    // Start a new meshlet from the next unused triangle
+
+                    flush();
+                    while (emitted[scan]) {
+                        scan++;
+                    }
+                    triangle = scan;
+                }
+
+                Vec3<uint8_t> local;
+                auto vertices = triangle_vertices(triangle);
+                for (uint32_t k = 0; k < 3; ++k) {
+                    uint32_t v = vertices[k];
+                    if (vertex_local[v] == Invalid) {
+                        vertex_local[v] = current.vertex_count++;
+                        out.vertices.push_back(v);
+                        centroid_sum += positions[v];
+                    }
+                    local[k] = uint8_t(vertex_local[v]);
+                }
+
+                out.triangles.push_back(local);
+                current.triangle_count++;
+                emitted[triangle] = 1;
+                if (fill_nearest) {
+                    tree.Remove(triangle);
+                }
+                last_triangle = triangle;
+
+                if (current.triangle_count == max_triangles) {
+                    flush();
+                    last_triangle = Invalid;
+                }
+            }
+
+            flush();
+        }
+    };
+
+    inline
+    void Meshletize(Importer& importer, Scene& scene)
+    {
+        auto& memory_pool = importer.memory_pool;
+        auto& settings = importer.settings;
+        auto& ranges = scene.geometry_ranges;
+
+        if (settings.meshlet_max_vertices < 3 || settings.meshlet_max_vertices > 256 || settings.meshlet_max_triangles < 1) {
+            Error("Invalid meshlet limits: max vertices = {}, max triangles = {}",
+                settings.meshlet_max_vertices, settings.meshlet_max_triangles);
+        }
+
+        using namespace std::chrono;
+        auto start = steady_clock::now();
+
+        std::vector<MeshletSet> sets(ranges.count);
+
+#pragma omp parallel
+        {
+            MeshletBuilder builder {
+                .max_vertices = settings.meshlet_max_vertices,
+                .max_triangles = settings.meshlet_max_triangles,
+            };
+
+#pragma omp for schedule(dynamic)
+            for (uint32_t i = 0; i < ranges.count; ++i) {
+                auto& range = ranges[i];
+                auto& geometry = scene.geometries[range.geometry_idx];
+                builder.Build(
+                    geometry.indices.Slice(range.first_index, range.triangle_count * 3),
+                    geometry.positions.Slice(range.vertex_offset, range.max_vertex + 1),
+                    sets[i]);
+            }
+        }
+
+        // Flatten into scene ranges, per geometry page
+
+        uint64_t total_meshlet_count = 0;
+        uint64_t total_meshlet_vertex_count = 0;
+        uint64_t total_meshlet_triangle_count = 0;
+
+        std::vector<Meshlet> bases(ranges.count);
+
+        for (uint32_t p = 0; p < scene.geometries.count; ++p) {
+            auto& geometry = scene.geometries[p];
+
+            uint64_t meshlet_count = 0;
+            uint64_t meshlet_vertex_count = 0;
+            uint64_t meshlet_triangle_count = 0;
+
+            for (uint32_t i = geometry.first_range; i < geometry.first_range + geometry.range_count; ++i) {
+                bases[i] = { .vertex_offset = uint32_t(meshlet_vertex_count), .triangle_offset = uint32_t(meshlet_triangle_count) };
+                ranges[i].first_meshlet = uint32_t(meshlet_count);
+                ranges[i].meshlet_count = uint32_t(sets[i].meshlets.size());
+                meshlet_count += sets[i].meshlets.size();
+                meshlet_vertex_count += sets[i].vertices.size();
+                meshlet_triangle_count += sets[i].triangles.size();
+            }
+
+            if (meshlet_vertex_count > UINT32_MAX || meshlet_triangle_count > UINT32_MAX) {
+                Error("Meshlet data exceeds 32 bit offsets in a geometry page, reduce the geometry page size");
+            }
+
+            geometry.meshlets          = { memory_pool.Allocate<Meshlet>(meshlet_count),                meshlet_count          };
+            geometry.meshlet_bounds    = { memory_pool.Allocate<MeshletBounds>(meshlet_count),          meshlet_count          };
+            geometry.meshlet_vertices  = { memory_pool.Allocate<uint32_t>(meshlet_vertex_count),        meshlet_vertex_count   };
+            geometry.meshlet_triangles = { memory_pool.Allocate<Vec3<uint8_t>>(meshlet_triangle_count), meshlet_triangle_count };
+
+            total_meshlet_count += meshlet_count;
+            total_meshlet_vertex_count += meshlet_vertex_count;
+            total_meshlet_triangle_count += meshlet_triangle_count;
+        }
+
+#pragma omp parallel for schedule(dynamic)
+        for (uint32_t i = 0; i < ranges.count; ++i) {
+            auto& geometry = scene.geometries[ranges[i].geometry_idx];
+            auto& set = sets[i];
+            auto& base = bases[i];
+
+            for (uint32_t j = 0; j < set.meshlets.size(); ++j) {
+                auto meshlet = set.meshlets[j];
+                meshlet.vertex_offset += base.vertex_offset;
+                meshlet.triangle_offset += base.triangle_offset;
+                geometry.meshlets[ranges[i].first_meshlet + j] = meshlet;
+                geometry.meshlet_bounds[ranges[i].first_meshlet + j] = set.bounds[j];
+            }
+
+            std::ranges::copy(set.vertices, &geometry.meshlet_vertices[base.vertex_offset]);
+            std::ranges::copy(set.triangles, &geometry.meshlet_triangles[base.triangle_offset]);
+        }
+
+        auto end = steady_clock::now();
+
+        fmt::println("Built {} meshlets ({:.1f} vertices, {:.1f} triangles avg) in {} ms",
+            total_meshlet_count,
+            total_meshlet_count ? double(total_meshlet_vertex_count) / total_meshlet_count : 0.0,
+            total_meshlet_count ? double(total_meshlet_triangle_count) / total_meshlet_count : 0.0,
+            duration_cast<milliseconds>(end - start).count());
+    }
+}
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <imp/imp_Importer.hpp>
+
+#include "imp_MeshAdjacency.hpp"
+#include "imp_ProcessGeometry.hpp"
+
+namespace imp::detail
+{
+    // Number of post-transform cache misses for a FIFO cache of the given size
+
+    inline
+    uint64_t CountVertexCacheMisses(Range<uint32_t> indices, uint32_t vertex_count, uint32_t cache_size, std::vector<uint32_t>& timestamps)
+    {
+        timestamps.assign(vertex_count, 0);
+
+        uint64_t misses = 0;
+        uint32_t time = cache_size + 1;
+        for (uint32_t j = 0; j < indices.count; ++j) {
+            auto& stamp = timestamps[indices[j]];
+            if (time - stamp > cache_size) {
+                stamp = time++;
+                misses++;
+            }
+        }
+
+        return misses;
+    }
+
+    // Linear-speed vertex cache optimization (Tipsify, Sander et al. 2007), followed by
+    //  remapping vertices into first use order for vertex fetch locality
+
+    struct VertexCacheOptimizer
+    {
+        uint32_t cache_size;
+
+        VertexTriangleAdjacency adjacency;
+        std::vector<uint32_t>   live_triangles;
+        std::vector<uint32_t>   timestamps;
+        std::vector<uint32_t>   dead_end;
+        std::vector<uint8_t>    emitted;
+        std::vector<uint32_t>   candidates;
+        std::vector<uint32_t>   output;
+
+    public:
+        void OptimizeIndices(Range<uint32_t> indices, uint32_t vertex_count)
+        {
+            constexpr uint32_t Invalid = UINT32_MAX;
+
+            uint32_t triangle_count = uint32_t(indices.count / 3);
+
+            adjacency.Build(indices, vertex_count);
+
+            live_triangles.resize(vertex_count);
+            for (uint32_t v = 0; v < vertex_count; ++v) {
+                live_triangles[v] = uint32_t(adjacency[v].size());
+            }
+
+            timestamps.assign(vertex_count, 0);
+            emitted.assign(triangle_count, 0);
+            dead_end.clear();
+            output.clear();
+
+            uint32_t time = cache_size + 1;
+            uint32_t cursor = 1;
+
+            auto skip_dead_end = [&]() -> uint32_t {
+                while (!dead_end.empty()) {
+                    uint32_t v = dead_end.back();
+                    dead_end.pop_back();
+                    if (live_triangles[v] > 0) {
+                        return v;
+                    }
+                }
+                for (; cursor < vertex_count; ++cursor) {
+                    if (live_triangles[cursor] > 0) {
+                        return cursor;
+                    }
+                }
+                return Invalid;
+            };
+
+            auto next_vertex = [&]() -> uint32_t {
+                uint32_t best = Invalid;
+                int64_t best_priority = -1;
+                for (uint32_t v : candidates) {
+                    if (live_triangles[v] > 0) {
+
+                        // Prefer the oldest vertex that will still be in cache after its remaining triangles are emitted
+
+                        int64_t priority = 0;
+                        if (time - timestamps[v] + 2 * live_triangles[v] <= cache_size) {
+                            priority = time - timestamps[v];
+                        }
+                        if (priority > best_priority) {
+                            best_priority = priority;
+                            best = v;
+                        }
+                    }
+                }
+                return best == Invalid ? skip_dead_end() : best;
+            };
+
+            uint32_t fan = vertex_count ? 0 : Invalid;
+            while (fan != Invalid) {
+                candidates.clear();
+                for (uint32_t triangle : adjacency[fan]) {
+                    if (emitted[triangle]) {
+                        continue;
+                    }
+
+                    for (uint32_t k = 0; k < 3; ++k) {
+                        uint32_t v = indices[triangle * 3 + k];
+                        output.push_back(v);
+                        dead_end.push_back(v);
+                        candidates.push_back(v);
+                        live_triangles[v]--;
+                        if (time - timestamps[v] > cache_size) {
+                            timestamps[v] = time++;
+                        }
+                    }
+                    emitted[triangle] = 1;
+                }
+                fan = next_vertex();
+            }
+
+            std::copy(output.begin(), output.end(), indices.begin);
+        }
+
+        // Reorders vertices in first use order. Unreferenced vertices are kept at the end.
+
+        template<class... Attributes>
+        void OptimizeVertexFetch(Range<uint32_t> indices, uint32_t vertex_count, Attributes... attributes)
+        {
+            constexpr uint32_t Invalid = UINT32_MAX;
+
+            auto& remap = timestamps;
+            remap.assign(vertex_count, Invalid);
+
+            uint32_t next = 0;
+            for (uint32_t j = 0; j < indices.count; ++j) {
+                auto& target = remap[indices[j]];
+                if (target == Invalid) {
+                    target = next++;
+                }
+                indices[j] = target;
+            }
+            for (uint32_t v = 0; v < vertex_count; ++v) {
+                if (remap[v] == Invalid) {
+                    remap[v] = next++;
+                }
+            }
+
+            auto reorder = [&]<class T>(Range<T> attribute) {
+                std::vector<T> copy(attribute.begin, attribute.begin + vertex_count);
+                for (uint32_t v = 0; v < vertex_count; ++v) {
+                    attribute[remap[v]] = copy[v];
+                }
+            };
+
+            (reorder(attributes), ...);
+        }
+    };
+
+    inline
+    void OptimizeVertexCache(Importer& importer, Scene& scene)
+    {
+        auto& settings = importer.settings;
+        auto& ranges = scene.geometry_ranges;
+
+        using namespace std::chrono;
+        auto start = steady_clock::now();
+
+        uint64_t misses_before = 0;
+        uint64_t misses_after = 0;
+        uint64_t triangle_count = 0;
+
+#pragma omp parallel reduction(+: misses_before, misses_after, triangle_count)
+        {
+            VertexCacheOptimizer optimizer { .cache_size = settings.vertex_cache_size };
+
+#pragma omp for schedule(dynamic)
+            for (uint32_t i = 0; i < ranges.count; ++i) {
+                auto& range = ranges[i];
+                auto& geometry = scene.geometries[range.geometry_idx];
+                uint32_t vertex_count = range.max_vertex + 1;
+                auto indices = geometry.indices.Slice(range.first_index, range.triangle_count * 3);
+
+                misses_before += CountVertexCacheMisses(indices, vertex_count, optimizer.cache_size, optimizer.timestamps);
+
+                optimizer.OptimizeIndices(indices, vertex_count);
+
+                auto optimize_vertex_fetch = [&](auto tex_coords) {
+                    optimizer.OptimizeVertexFetch(indices, vertex_count,
+                        geometry.positions.Slice(range.vertex_offset, vertex_count),
+                        geometry.tangent_spaces.Slice(range.vertex_offset, vertex_count),
+                        tex_coords);
+                };
+
+                if (range.tex_coord_format == TexCoordFormat::UNorm8) {
+                    optimize_vertex_fetch(GetRangeTexCoords<Vec2<UNorm8>>(geometry, range));
+                } else {
+                    optimize_vertex_fetch(GetRangeTexCoords<Vec2<UNorm16>>(geometry, range));
+                }
+
+                misses_after += CountVertexCacheMisses(indices, vertex_count, optimizer.cache_size, optimizer.timestamps);
+                triangle_count += range.triangle_count;
+            }
+        }
+
+        auto end = steady_clock::now();
+
+        auto acmr = [&](uint64_t misses) {
+            return triangle_count ? double(misses) / double(triangle_count) : 0.0;
+        };
+
+        fmt::println("Optimized vertex cache (size {}), ACMR {:.3f} -> {:.3f} in {} ms",
+            settings.vertex_cache_size, acmr(misses_before), acmr(misses_after),
+            duration_cast<milliseconds>(end - start).count());
+    }
+}
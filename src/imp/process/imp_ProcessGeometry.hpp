@@ -2,186 +2,420 @@
 
 #include <imp/imp_Importer.hpp>
 #include <imp/imp_BasisMath.hpp>
+#include <imp/imp_BasisMathBatch.hpp>
+
+#include "imp_MeshAdjacency.hpp"
+
+#include <utility>
 
 namespace imp::detail
 {
+    // Geometries with at least this many triangles accumulate their tangent spaces
+    //  with a parallel per-vertex gather instead of a serial per-face scatter
+
+    constexpr uint32_t ParallelBasisTriangleThreshold = 1 << 18;
+
+    // Bytes per vertex counted against the geometry page budget
+
+    constexpr uint64_t GeometryVertexBytes = sizeof(glm::vec3) + sizeof(Basis) + sizeof(Vec2<Float16>);
+
+    struct FaceBasis
+    {
+        glm::vec3 normal;
+        glm::vec3 tangent;
+        glm::vec3 bitangent;
+        float     area;
+    };
+
+    inline
+    FaceBasis ComputeFaceBasis(const InGeometry& geometry, uint32_t first_index)
+    {
+        uint32_t v1i = geometry.indices[first_index + 0];
+        uint32_t v2i = geometry.indices[first_index + 1];
+        uint32_t v3i = geometry.indices[first_index + 2];
+
+        auto v1 = geometry.positions[v1i];
+        auto v2 = geometry.positions[v2i];
+        auto v3 = geometry.positions[v3i];
+
+        auto v12 = v2 - v1;
+        auto v13 = v3 - v1;
+
+        glm::vec3 tangent = {};
+        glm::vec3 bitangent = {};
+
+        if (geometry.tex_coords.count) {
+            auto tc1 = geometry.tex_coords[v1i];
+            auto tc2 = geometry.tex_coords[v2i];
+            auto tc3 = geometry.tex_coords[v3i];
+
+            auto u12 = tc2 - tc1;
+            auto u13 = tc3 - tc1;
+
+            float f = 1.f / (u12.x * u13.y - u13.x * u12.y);
+
+            tangent = f * glm::vec3 {
+                u13.y * v12.x - u12.y * v13.x,
+                u13.y * v12.y - u12.y * v13.y,
+                u13.y * v12.z - u12.y * v13.z,
+            };
+
+            bitangent = f * glm::vec3 {
+                u13.x * v12.x - u12.x * v13.x,
+                u13.x * v12.y - u12.x * v13.y,
+                u13.x * v12.z - u12.x * v13.z,
+            };
+        }
+
+        auto cross = glm::cross(v12, v13);
+        auto area = glm::length(0.5f * cross);
+        auto normal = glm::normalize(cross);
+
+        return { normal, tangent, bitangent, area };
+    }
+
+    inline
+    void AccumulateFaceBasis(VertexBasis& v, const FaceBasis& face, bool has_normals)
+    {
+        if (!has_normals) {
+            v.normal += face.area * face.normal;
+        }
+        v.tangent   += face.area * face.tangent;
+        v.bitangent += face.area * face.bitangent;
+    }
+
+    // Tex coords are stored as offset + unorm * scale over the bounds of each range, UNorm8 is
+    //  used when its error is within budget. Each range is packed at the width of its format.
+
+    inline
+    uint32_t GetTexCoordSize(TexCoordFormat format)
+    {
+        switch (format) {
+            break;case TexCoordFormat::Float16: return sizeof(Vec2<Float16>);
+            break;case TexCoordFormat::UNorm16: return sizeof(Vec2<UNorm16>);
+            break;case TexCoordFormat::UNorm8:  return sizeof(Vec2<UNorm8>);
+        }
+        std::unreachable();
+    }
+
+    // Typed view of a range's tex coords, T must match the size of its format
+
+    template<class T>
+    Range<T> GetRangeTexCoords(const Geometry& geometry, const GeometryRange& range)
+    {
+        return { reinterpret_cast<T*>(&geometry.tex_coords[range.tex_coord_byte_offset]), range.max_vertex + 1 };
+    }
+
+    inline
+    void ChooseTexCoordFormat(Range<const glm::vec2> tex_coords, GeometryRange& range, float max_error)
+    {
+        if (!tex_coords.count) {
+            range.tex_coord_format = TexCoordFormat::UNorm8;
+            return;
+        }
+
+        glm::vec2 min = tex_coords[0];
+        glm::vec2 max = tex_coords[0];
+        for (uint32_t v = 1; v < tex_coords.count; ++v) {
+            min = glm::min(min, tex_coords[v]);
+            max = glm::max(max, tex_coords[v]);
+        }
+
+        auto extent = max - min;
+        range.tex_coord_offset = min;
+        range.tex_coord_scale = { extent.x > 0.f ? extent.x : 1.f, extent.y > 0.f ? extent.y : 1.f };
+
+        float unorm8_error = std::max(extent.x, extent.y) / (2.f * 255.f);
+        range.tex_coord_format = unorm8_error <= max_error ? TexCoordFormat::UNorm8 : TexCoordFormat::UNorm16;
+    }
+
+    template<class T>
+    float PackTexCoordsUNorm(const glm::vec2* in, Vec2<T>* out, uint32_t count, const GeometryRange& range)
+    {
+        constexpr float Levels = float(std::numeric_limits<T>::max());
+
+        float max_error = 0.f;
+        for (uint32_t v = 0; v < count; ++v) {
+            for (uint32_t k = 0; k < 2; ++k) {
+                float t = glm::clamp((in[v][k] - range.tex_coord_offset[k]) / range.tex_coord_scale[k], 0.f, 1.f);
+                T q = T(t * Levels + 0.5f);
+                out[v][k] = q;
+
+                float decoded = range.tex_coord_offset[k] + float(q) / Levels * range.tex_coord_scale[k];
+                max_error = std::max(max_error, std::abs(decoded - in[v][k]));
+            }
+        }
+
+        return max_error;
+    }
+
+    inline
+    void ReportTexCoordQuantization(Range<GeometryRange> ranges)
+    {
+        uint32_t unorm8_count = 0;
+        uint32_t worst = 0;
+        for (uint32_t i = 0; i < ranges.count; ++i) {
+            auto& range = ranges[i];
+            unorm8_count += range.tex_coord_format == TexCoordFormat::UNorm8;
+            if (range.tex_coord_max_error > ranges[worst].tex_coord_max_error) {
+                worst = i;
+            }
+        }
+
+        fmt::println("Quantized tex coords, {} UNorm8 / {} UNorm16 ranges, max error {} (range {})",
+            unorm8_count, ranges.count - unorm8_count, ranges.count ? ranges[worst].tex_coord_max_error : 0.f, worst);
+    }
+
     inline
-    void ProcessGeometry(Importer& importer, Scene& scene)
+    void ProcessGeometry(Importer& importer, Scene& scene, std::span<const InGeometry> geometries)
     {
         auto& memory_pool = importer.memory_pool;
-        auto& geometries = importer.geometries;
 
         // Geometries
 
         scene.geometry_ranges = { memory_pool.Allocate<GeometryRange>(geometries.size()), geometries.size() };
 
-        // Build geometry ranges and compute accumulated geometry stats
+        // Build geometry ranges and split them into pages. A page is closed when adding the
+        //  next range would exceed the byte budget or 32 bit vertex / index offsets.
+
+        struct PageInfo
+        {
+            uint32_t first_range;
+            uint32_t range_count;
+            uint32_t vertex_count;
+            uint32_t index_count;
+        };
+
+        std::vector<PageInfo> pages;
+
+        uint64_t total_vertex_count = 0;
+        uint64_t total_index_count = 0;
+        uint64_t page_bytes = 0;
+        uint64_t max_page_bytes = importer.settings.geometry_page_bytes ? importer.settings.geometry_page_bytes : UINT64_MAX;
 
-        uint32_t index_count = 0;
-        uint32_t vertex_count = 0;
-        uint32_t max_vertex_count_per_range = 0;
-        uint32_t max_index_count_per_range = 0;
         for (uint32_t i = 0; i < geometries.size(); ++i) {
             auto& geometry = geometries[i];
+
+            if (geometry.positions.count > UINT32_MAX || geometry.indices.count > UINT32_MAX) {
+                Error("Geometry {} exceeds 32 bit vertex or index counts", i);
+            }
+
+            uint64_t range_bytes = geometry.positions.count * GeometryVertexBytes + geometry.indices.count * sizeof(uint32_t);
+
+            if (pages.empty()
+                    || (pages.back().range_count && (page_bytes + range_bytes > max_page_bytes
+                        || pages.back().vertex_count + geometry.positions.count > UINT32_MAX
+                        || pages.back().index_count + geometry.indices.count > UINT32_MAX))) {
+                pages.push_back(PageInfo { .first_range = i });
+                page_bytes = 0;
+            }
+
+            auto& page = pages.back();
             scene.geometry_ranges[i] = GeometryRange {
-                .geometry_idx = 0,
-                .vertex_offset = vertex_count,
+                .geometry_idx = uint32_t(pages.size() - 1),
+                .vertex_offset = page.vertex_count,
                 .max_vertex = uint32_t(geometry.positions.count - 1),
-                .first_index = index_count,
+                .first_index = page.index_count,
                 .triangle_count = uint32_t(geometry.indices.count / 3),
             };
-            index_count += uint32_t(geometry.indices.count);
-            vertex_count += uint32_t(geometry.positions.count);
-            max_vertex_count_per_range = std::max(max_vertex_count_per_range, uint32_t(geometry.positions.count));
-            max_index_count_per_range = std::max(max_index_count_per_range, uint32_t(geometry.indices.count));
+            page.range_count++;
+            page.vertex_count += uint32_t(geometry.positions.count);
+            page.index_count += uint32_t(geometry.indices.count);
+            page_bytes += range_bytes;
+            total_vertex_count += geometry.positions.count;
+            total_index_count += geometry.indices.count;
         }
 
-        // Allocate geometry
+        // Allocate geometry pages
+
+        scene.geometries = { memory_pool.Allocate<Geometry>(pages.size()), pages.size() };
+        for (uint32_t p = 0; p < pages.size(); ++p) {
+            auto& page = pages[p];
+            scene.geometries[p] = Geometry {
+                .first_range    = page.first_range,
+                .range_count    = page.range_count,
+                .indices        = { memory_pool.Allocate<uint32_t>(page.index_count),       page.index_count  },
+                .positions      = { memory_pool.Allocate<glm::vec3>(page.vertex_count),     page.vertex_count },
+                .tangent_spaces = { memory_pool.Allocate<Basis>(page.vertex_count),         page.vertex_count },
+            };
+        }
 
-        scene.geometries = { memory_pool.Allocate<Geometry>(1), 1 };
-        scene.geometries[0] = Geometry {
-            .indices        = { memory_pool.Allocate<uint32_t>(index_count),       index_count  },
-            .positions      = { memory_pool.Allocate<glm::vec3>(vertex_count),     vertex_count },
-            .tangent_spaces = { memory_pool.Allocate<Basis>(vertex_count),         vertex_count },
-            .tex_coords     = { memory_pool.Allocate<Vec2<Float16>>(vertex_count), vertex_count },
-        };
+        // Choose per range tex coord formats up front, these are written in the same pass as the tangent spaces
 
-        // Temporary vertex basis scratch space
+        if (importer.settings.quantize_tex_coords) {
+#pragma omp parallel for schedule(dynamic)
+            for (uint32_t i = 0; i < geometries.size(); ++i) {
+                ChooseTexCoordFormat(geometries[i].tex_coords, scene.geometry_ranges[i], importer.settings.tex_coord_max_error);
+            }
+        }
 
-        struct VertexBasis
-        {
-            glm::vec3 normal = {};
-            glm::vec3 tangent = {};
-            glm::vec3 bitangent = {};
-        };
-        std::vector<VertexBasis> vertex_basis(max_vertex_count_per_range);
+        for (uint32_t p = 0; p < pages.size(); ++p) {
+            auto& page = scene.geometries[p];
 
-        using namespace std::chrono;
-        steady_clock::duration elapsed = {};
+            uint64_t tex_coord_bytes = 0;
+            for (uint32_t i = page.first_range; i < page.first_range + page.range_count; ++i) {
+                auto& range = scene.geometry_ranges[i];
+                range.tex_coord_byte_offset = tex_coord_bytes;
+                tex_coord_bytes += uint64_t(range.max_vertex + 1) * GetTexCoordSize(range.tex_coord_format);
+            }
 
-        for (uint32_t i = 0; i < geometries.size(); ++i) {
-            auto& geometry = geometries[i];
-            auto& range = scene.geometry_ranges[i];
+            page.tex_coords = { memory_pool.Allocate<std::byte>(tex_coord_bytes), tex_coord_bytes };
+        }
 
-            bool has_normals = geometry.normals.count;
-            bool has_texcoords = geometry.tex_coords.count;
+        auto is_large = [&](uint32_t i) {
+            return scene.geometry_ranges[i].triangle_count >= ParallelBasisTriangleThreshold;
+        };
 
-            std::fill(vertex_basis.begin(), vertex_basis.begin() + range.max_vertex + 1, VertexBasis());
+        // Quantizes tangent spaces and packs tex coords for up to one batch of vertices,
+        //  returns the max tex coord quantization error in the batch. The max over each range is
+        //  kept in GeometryRange::tex_coord_max_error.
 
-            if (has_normals) {
-                for (uint32_t i = 0; i < geometry.normals.count; ++i) {
-                    vertex_basis[i].normal = geometry.normals[i];
-                }
+        auto write_vertices = [&](const InGeometry& geometry, const GeometryRange& range, uint32_t first, const VertexBasisBatch& basis, uint32_t count) {
+            auto& geometry_out = scene.geometries[range.geometry_idx];
+            QuantizeBasisBatch(basis, &geometry_out.tangent_spaces[range.vertex_offset + first], count);
+
+            uint32_t tex_coord_size = GetTexCoordSize(range.tex_coord_format);
+            auto* tex_coords_out = &geometry_out.tex_coords[range.tex_coord_byte_offset + uint64_t(first) * tex_coord_size];
+            if (!geometry.tex_coords.count) {
+                std::memset(tex_coords_out, 0, count * tex_coord_size);
+                return 0.f;
             }
 
-            geometry.indices.CopyTo(scene.geometries[0].indices.Slice(range.first_index));
-            geometry.positions.CopyTo(scene.geometries[0].positions.Slice(range.vertex_offset));
+            switch (range.tex_coord_format) {
+                break;case TexCoordFormat::Float16:
+                    PackHalf2x16Batch(&geometry.tex_coords[first], reinterpret_cast<Vec2<Float16>*>(tex_coords_out), count);
+                break;case TexCoordFormat::UNorm16:
+                    return PackTexCoordsUNorm(&geometry.tex_coords[first], reinterpret_cast<Vec2<UNorm16>*>(tex_coords_out), count, range);
+                break;case TexCoordFormat::UNorm8:
+                    return PackTexCoordsUNorm(&geometry.tex_coords[first], reinterpret_cast<Vec2<UNorm8>*>(tex_coords_out), count, range);
+            }
+            return 0.f;
+        };
 
-            // Accumulate area weighted tangent space for each face
+        using namespace std::chrono;
+        auto start = steady_clock::now();
 
-            auto update_basis = [&](uint32_t vid, glm::vec3 normal, glm::vec3 tangent, glm::vec3 bitangent, float area)
-            {
-                auto& v = vertex_basis[vid];
+        // Geometries are processed as independent tasks, all output offsets are
+        //  precomputed in the geometry ranges so results are deterministic
 
-                if (!has_normals) {
-                    v.normal += area * normal;
-                }
-                v.tangent   += area * tangent;
-                v.bitangent += area * bitangent;
-            };
+#pragma omp parallel
+        {
+            // Per-worker vertex basis scratch space
 
-            for (uint32_t j = 0; j < geometry.indices.count; j += 3) {
-                uint32_t v1i = geometry.indices[j + 0];
-                uint32_t v2i = geometry.indices[j + 1];
-                uint32_t v3i = geometry.indices[j + 2];
+            std::vector<VertexBasis> vertex_basis;
 
-                auto v1 = geometry.positions[v1i];
-                auto v2 = geometry.positions[v2i];
-                auto v3 = geometry.positions[v3i];
+#pragma omp for schedule(dynamic)
+            for (uint32_t i = 0; i < geometries.size(); ++i) {
+                if (is_large(i)) {
+                    continue;
+                }
 
-                auto v12 = v2 - v1;
-                auto v13 = v3 - v1;
+                auto& geometry = geometries[i];
+                auto& range = scene.geometry_ranges[i];
 
-                glm::vec3 tangent = {};
-                glm::vec3 bitangent = {};
+                bool has_normals = geometry.normals.count;
 
-                if (has_texcoords) {
-                    auto tc1 = geometry.tex_coords[v1i];
-                    auto tc2 = geometry.tex_coords[v2i];
-                    auto tc3 = geometry.tex_coords[v3i];
+                vertex_basis.assign(geometry.positions.count, VertexBasis());
 
-                    auto u12 = tc2 - tc1;
-                    auto u13 = tc3 - tc1;
+                if (has_normals) {
+                    for (uint32_t i = 0; i < geometry.normals.count; ++i) {
+                        vertex_basis[i].normal = geometry.normals[i];
+                    }
+                }
 
-                    float f = 1.f / (u12.x * u13.y - u13.x * u12.y);
+                geometry.indices.CopyTo(scene.geometries[range.geometry_idx].indices.Slice(range.first_index));
+                geometry.positions.CopyTo(scene.geometries[range.geometry_idx].positions.Slice(range.vertex_offset));
 
-                    tangent = f * glm::vec3 {
-                        u13.y * v12.x - u12.y * v13.x,
-                        u13.y * v12.y - u12.y * v13.y,
-                        u13.y * v12.z - u12.y * v13.z,
-                    };
+                // Accumulate area weighted tangent space for each face
 
-                    bitangent = f * glm::vec3 {
-                        u13.x * v12.x - u12.x * v13.x,
-                        u13.x * v12.y - u12.x * v13.y,
-                        u13.x * v12.z - u12.x * v13.z,
-                    };
+                for (uint32_t j = 0; j < geometry.indices.count; j += 3) {
+                    auto face = ComputeFaceBasis(geometry, j);
+                    if (face.area) {
+                        AccumulateFaceBasis(vertex_basis[geometry.indices[j + 0]], face, has_normals);
+                        AccumulateFaceBasis(vertex_basis[geometry.indices[j + 1]], face, has_normals);
+                        AccumulateFaceBasis(vertex_basis[geometry.indices[j + 2]], face, has_normals);
+                    }
                 }
 
-                auto cross = glm::cross(v12, v13);
-                auto area = glm::length(0.5f * cross);
-                auto normal = glm::normalize(cross);
+                // Quantize generated tangent spaces
 
-                if (area) {
-                    update_basis(v1i, normal, tangent, bitangent, area);
-                    update_basis(v2i, normal, tangent, bitangent, area);
-                    update_basis(v3i, normal, tangent, bitangent, area);
+                float tex_coord_error = 0.f;
+                VertexBasisBatch batch;
+                for (uint32_t j = 0; j < geometry.positions.count; j += BasisBatchSize) {
+                    uint32_t count = std::min(BasisBatchSize, uint32_t(geometry.positions.count - j));
+                    for (uint32_t k = 0; k < BasisBatchSize; ++k) {
+                        batch.Set(k, k < count ? vertex_basis[j + k] : VertexBasis());
+                    }
+                    tex_coord_error = std::max(tex_coord_error, write_vertices(geometry, range, j, batch, count));
                 }
+                range.tex_coord_max_error = tex_coord_error;
             }
+        }
 
-            // Quantize generated tangent spaces
+        // Large geometries are processed one at a time with parallelism inside the geometry.
+        //  A vertex -> triangle adjacency (CSR) is built in index order, so gathering per vertex
+        //  sums face contributions in exactly the same order as the serial scatter.
 
-            auto start = steady_clock::now();
-#pragma omp parallel for
-            for (uint32_t j = 0; j < geometry.positions.count; ++j) {
-                auto& basis_in = vertex_basis[j];
-                Basis basis_out;
+        VertexTriangleAdjacency adjacency;
 
-                // Normalize and reorthogonalize generated tangent spaces
+        for (uint32_t i = 0; i < geometries.size(); ++i) {
+            if (!is_large(i)) {
+                continue;
+            }
+
+            auto& geometry = geometries[i];
+            auto& range = scene.geometry_ranges[i];
+
+            bool has_normals = geometry.normals.count;
+            uint32_t geom_vertex_count = uint32_t(geometry.positions.count);
+
+            geometry.indices.CopyTo(scene.geometries[range.geometry_idx].indices.Slice(range.first_index));
+            geometry.positions.CopyTo(scene.geometries[range.geometry_idx].positions.Slice(range.vertex_offset));
 
-                basis_in.normal = glm::normalize(basis_in.normal);
-                basis_in.tangent = glm::normalize(basis_in.tangent);
-                basis_in.tangent = detail::Reorthogonalize(basis_in.tangent, basis_in.normal);
-                basis_in.bitangent = glm::normalize(basis_in.bitangent);
+            adjacency.Build(geometry.indices, geom_vertex_count);
 
-                auto enc_normal = detail::SignedOctEncode(basis_in.normal);
-                basis_out.oct_x = uint32_t(enc_normal.x * 1023.f);
-                basis_out.oct_y = uint32_t(enc_normal.y * 1023.f);
-                basis_out.oct_s = uint32_t(enc_normal.z);
+            // Gather tangent space per vertex and quantize
 
-                // Decode quantized normal before computing tangent to
-                //  ensure consistent tangent basis
+            float tex_coord_error = 0.f;
 
-                auto decoded_normal = detail::SignedOctDecode(glm::vec3 {
-                    float(basis_out.oct_x) / 1023.f,
-                    float(basis_out.oct_y) / 1023.f,
-                    float(basis_out.oct_s),
-                });
+#pragma omp parallel for schedule(dynamic, 512) reduction(max: tex_coord_error)
+            for (uint32_t first = 0; first < geom_vertex_count; first += BasisBatchSize) {
+                uint32_t count = std::min(BasisBatchSize, geom_vertex_count - first);
 
-                auto enc_tangent = detail::EncodeTangent(decoded_normal, basis_in.tangent);
-                basis_out.tgt_a = uint32_t(enc_tangent * 1023.f);
+                VertexBasisBatch batch;
+                for (uint32_t k = 0; k < BasisBatchSize; ++k) {
+                    uint32_t v = first + k;
 
-                auto enc_bitangent = glm::dot(glm::cross(basis_in.normal, basis_in.tangent), basis_in.bitangent) > 0.f;
-                basis_out.btg_s = uint32_t(enc_bitangent);
+                    VertexBasis basis;
+                    if (k < count) {
+                        if (has_normals && v < geometry.normals.count) {
+                            basis.normal = geometry.normals[v];
+                        }
 
-                scene.geometries[0].tangent_spaces[range.vertex_offset + j] = basis_out;
-                scene.geometries[0].tex_coords[range.vertex_offset + j] =
-                    std::bit_cast<Vec2<Float16>>(glm::packHalf2x16(geometry.tex_coords[j]));
+                        for (uint32_t triangle : adjacency[v]) {
+                            auto face = ComputeFaceBasis(geometry, triangle * 3);
+                            if (face.area) {
+                                AccumulateFaceBasis(basis, face, has_normals);
+                            }
+                        }
+                    }
+
+                    batch.Set(k, basis);
+                }
+
+                tex_coord_error = std::max(tex_coord_error, write_vertices(geometry, range, first, batch, count));
             }
-            auto end = steady_clock::now();
-            elapsed += (end - start);
+
+            range.tex_coord_max_error = tex_coord_error;
         }
 
-        fmt::println("Processed all geometry in {} ms", duration_cast<milliseconds>(elapsed).count());
+        auto end = steady_clock::now();
+
+        fmt::println("Processed all geometry ({} vertices, {} indices in {} pages) in {} ms",
+            total_vertex_count, total_index_count, pages.size(), duration_cast<milliseconds>(end - start).count());
+
+        if (importer.settings.quantize_tex_coords) {
+            ReportTexCoordQuantization(scene.geometry_ranges);
+        }
     }
-}
\ No newline at end of file
+}
@@ -1,124 +1,1006 @@
 #pragma once
 
 #include <imp/imp_Importer.hpp>
+#include <imp/imp_FileMapping.hpp>
 
 #include <stb_image.h>
+#include <omp.h>
+
+#include <numeric>
+#include <queue>
+
+#include "imp_ChannelKernels.hpp"
+#include "imp_ImageResample.hpp"
+#include "imp_TextureCompression.hpp"
 
 namespace imp::detail
 {
+    // Source image at 8 bits per channel, and RGBA float for HDR processes. Encoded files are
+    //  decoded straight from their source, raw 8 bit buffers are referenced in place in their
+    //  own layout.
+
+    struct DecodedImage
+    {
+        const uint8_t*     pixels = nullptr;
+        glm::uvec2         size = {};
+        uint32_t           channels = 0;
+        stbi_uc*           owned = nullptr;
+
+        const float*       float_pixels = nullptr;
+        float*             owned_float = nullptr;
+        std::vector<float> converted;
+
+        std::vector<uint8_t> resized;
+
+    public:
+        DecodedImage() = default;
+        DecodedImage(const DecodedImage&) = delete;
+        DecodedImage& operator=(const DecodedImage&) = delete;
+
+        ~DecodedImage()
+        {
+            if (owned) {
+                stbi_image_free(owned);
+            }
+            if (owned_float) {
+                stbi_image_free(owned_float);
+            }
+        }
+    };
+
+    // Downscales a decoded image in place, releasing the full resolution data. stb_image can't
+    //  decode at reduced size, so this runs straight after decode, before any processing.
+
     inline
-    void ProcessMaterials(Importer& importer, Scene& scene)
+    void DownscaleImage(DecodedImage& image, glm::uvec2 size, ImageFilter filter, bool srgb, bool parallel)
     {
-        auto& memory_pool = importer.memory_pool;
-        auto& textures = importer.textures;
-        auto& materials = importer.materials;
+        if (image.size == size) {
+            return;
+        }
 
-        struct LoadedTexture
+        if (image.pixels) {
+            std::vector<uint8_t> pixels(uint64_t(size.x) * size.y * image.channels);
+            ResampleImage(image.pixels, image.size, pixels.data(), size, image.channels, filter, srgb, parallel);
+            image.resized = std::move(pixels);
+            image.pixels = image.resized.data();
+            if (image.owned) {
+                stbi_image_free(image.owned);
+                image.owned = nullptr;
+            }
+        }
+
+        if (image.float_pixels) {
+            std::vector<float> pixels(uint64_t(size.x) * size.y * 4);
+            ResampleImage(image.float_pixels, image.size, pixels.data(), size, 4, filter, false, parallel);
+            image.converted = std::move(pixels);
+            image.float_pixels = image.converted.data();
+            if (image.owned_float) {
+                stbi_image_free(image.owned_float);
+                image.owned_float = nullptr;
+            }
+        }
+
+        image.size = size;
+    }
+
+    // Calls fn with the bytes of an encoded image file, mapping files from disk for the duration
+    //  of the call. Returns false for raw pixel buffers and sources that could not be read.
+
+    template<class Fn>
+    bool VisitEncodedImageBytes(const InImageDataSource& source, Fn&& fn)
+    {
+        return std::visit(OverloadSet {
+            [&](const InImageFileURI& uri) {
+                auto file = MappedFile::Open(uri.uri);
+                if (!file) {
+                    return false;
+                }
+                file->Advise(0, file->size, FileAccessHint::Sequential);
+                fn(Range<const std::byte> { file->data, file->size });
+                return true;
+            },
+            [&](const InImageFileBuffer& buffer) {
+                fn(buffer.data);
+                return true;
+            },
+            [&](const InImageBuffer&) {
+                return false;
+            },
+        }, source);
+    }
+
+    inline
+    bool ImageSourcesEqual(const InImageDataSource& a, const InImageDataSource& b)
+    {
+        auto equal_bytes = [](Range<const std::byte> l, Range<const std::byte> r) {
+            return l.count == r.count && std::memcmp(l.begin, r.begin, l.count) == 0;
+        };
+
+        auto* buffer_a = std::get_if<InImageBuffer>(&a);
+        auto* buffer_b = std::get_if<InImageBuffer>(&b);
+        if (buffer_a || buffer_b) {
+            return buffer_a && buffer_b
+                && buffer_a->size == buffer_b->size
+                && buffer_a->format == buffer_b->format
+                && equal_bytes(buffer_a->data, buffer_b->data);
+        }
+
+        bool equal = false;
+        VisitEncodedImageBytes(a, [&](Range<const std::byte> bytes_a) {
+            VisitEncodedImageBytes(b, [&](Range<const std::byte> bytes_b) {
+                equal = equal_bytes(bytes_a, bytes_b);
+            });
+        });
+        return equal;
+    }
+
+    // Content of a source, encoded file bytes or raw pixels with their layout. Hashed before
+    //  decoding so identical images referenced through different textures or URIs are decoded
+    //  once. Content is only compared on a hash match, remapping files that are compared.
+
+    struct SourceContentKey
+    {
+        const InImageDataSource* source = nullptr;
+        uint64_t                 hash = 0;
+        uint64_t                 bytes = 0;
+
+        bool operator==(const SourceContentKey& other) const noexcept
+        {
+            return hash == other.hash
+                && bytes == other.bytes
+                && ImageSourcesEqual(*source, *other.source);
+        }
+    };
+
+    struct SourceContentKeyHash
+    {
+        using is_avalanching = void;
+        uint64_t operator()(const SourceContentKey& key) const noexcept
         {
-            glm::uvec2             size;
-            std::vector<glm::vec4> pixels;
+            return key.hash;
+        }
+    };
+
+    // Returns false if the source could not be read
+
+    inline
+    bool HashImageSource(const InImageDataSource& source, SourceContentKey& key)
+    {
+        using namespace ankerl::unordered_dense::detail;
+
+        if (auto* buffer = std::get_if<InImageBuffer>(&source)) {
+            uint64_t layout = wyhash::mix(uint64_t(buffer->size.x) << 32 | buffer->size.y, uint64_t(buffer->format));
+            key = { &source, wyhash::mix(wyhash::hash(buffer->data.begin, buffer->data.count), layout), buffer->data.count };
+            return true;
+        }
+
+        return VisitEncodedImageBytes(source, [&](Range<const std::byte> bytes) {
+            key = { &source, wyhash::hash(bytes.begin, bytes.count), bytes.count };
+        });
+    }
+
+    // Texture process compared and hashed bitwise, with sources resolved to the first source of
+    //  identical content. Processes with a function are never merged.
+
+    struct TextureProcessKey
+    {
+        std::array<int32_t, 4>  sources;
+        std::array<float, 12>   values;
+        std::array<uint8_t, 16> ops;
+        uint32_t                format;
+        uint32_t                normal_xy;
+        uint32_t                max_size;
 
-            void Resize(glm::uvec2 _size)
-            {
-                size = _size;
-                pixels.resize(size.x * size.y);
+    public:
+        TextureProcessKey(const InMaterial::TextureProcess& process)
+            : sources(process.sources)
+            , format(uint32_t(process.format))
+            , normal_xy(process.normal_xy)
+            , max_size(process.max_size)
+        {
+            for (uint32_t c = 0; c < 4; ++c) {
+                auto& op = process.channels[c];
+                values[c * 3 + 0] = op.value;
+                values[c * 3 + 1] = op.scale;
+                values[c * 3 + 2] = op.bias;
+                ops[c * 4 + 0] = uint8_t(op.input);
+                ops[c * 4 + 1] = op.channel;
+                ops[c * 4 + 2] = uint8_t(op.invert);
+                ops[c * 4 + 3] = uint8_t(op.conversion);
             }
+        }
+
+        bool operator==(const TextureProcessKey& other) const noexcept
+        {
+            return std::memcmp(this, &other, sizeof(TextureProcessKey)) == 0;
+        }
+    };
+
+    static_assert(sizeof(TextureProcessKey) == 92);
+
+    struct TextureProcessKeyHash
+    {
+        using is_avalanching = void;
+        uint64_t operator()(const TextureProcessKey& key) const noexcept
+        {
+            return ankerl::unordered_dense::detail::wyhash::hash(&key, sizeof(key));
+        }
+    };
+
+    // Every texture process of a material, all are scheduled together sharing decoded sources
+
+    constexpr std::array<InMaterial::TextureProcess InMaterial::*, 6> MaterialTextureProcesses = {
+        &InMaterial::basecolor_alpha,
+        &InMaterial::metalness,
+        &InMaterial::roughness,
+        &InMaterial::normal,
+        &InMaterial::emission,
+        &InMaterial::transmission,
+    };
+
+    // Packs the first channel of two single channel processes into one RG8 process, merging
+    //  their sources. Returns false if either has no source or a function, or if the merged
+    //  sources don't fit.
+
+    inline
+    bool CombineChannelProcesses(const InMaterial::TextureProcess& r, const InMaterial::TextureProcess& g, InMaterial::TextureProcess& out)
+    {
+        if (r.sources[0] < 0 || g.sources[0] < 0 || r.fn || g.fn || r.normal_xy || g.normal_xy) {
+            return false;
+        }
+
+        out = InMaterial::TextureProcess { .format = TextureFormat::RG8_UNORM };
+        out.channels[2] = { .input = InMaterial::ChannelOp::Constant };
+        out.channels[3] = { .input = InMaterial::ChannelOp::Constant, .value = 1.f };
 
-            glm::vec4& Get(glm::uvec2 pos)
-            {
-                return pixels[pos.x + pos.y * size.x];
+        for (uint32_t c = 0; c < 2; ++c) {
+            auto& process = c == 0 ? r : g;
+            auto op = process.channels[0];
+            if (op.input != InMaterial::ChannelOp::Constant) {
+                if (op.input < 0 || op.input >= 4 || process.sources[op.input] < 0) {
+                    return false;
+                }
+                int32_t source = process.sources[op.input];
+                auto slot = std::find(out.sources.begin(), out.sources.end(), source);
+                if (slot == out.sources.end()) {
+                    slot = std::find(out.sources.begin(), out.sources.end(), -1);
+                    if (slot == out.sources.end()) {
+                        return false;
+                    }
+                    *slot = source;
+                }
+                op.input = int8_t(slot - out.sources.begin());
+            }
+            out.channels[c] = op;
+        }
+
+        return true;
+    }
+
+    // Reads only the image header, returns false if the source is not a supported image
+
+    inline
+    bool QueryImageSize(const InImageDataSource& source, glm::uvec2& size)
+    {
+        int32_t width = 0, height = 0, channels = 0;
+        bool valid = std::visit(OverloadSet {
+            [&](const InImageFileURI& uri) {
+                return stbi_info(uri.uri.c_str(), &width, &height, &channels) != 0;
+            },
+            [&](const InImageFileBuffer& buffer) {
+                return stbi_info_from_memory(reinterpret_cast<const stbi_uc*>(buffer.data.begin), int32_t(buffer.data.count),
+                    &width, &height, &channels) != 0;
+            },
+            [&](const InImageBuffer& buffer) {
+                width = int32_t(buffer.size.x);
+                height = int32_t(buffer.size.y);
+                return !IsBlockCompressed(buffer.format)
+                    && buffer.data.count >= uint64_t(buffer.size.x) * buffer.size.y * GetBlockBytes(buffer.format);
+            },
+        }, source);
+
+        size = valid ? glm::uvec2(uint32_t(width), uint32_t(height)) : glm::uvec2(0);
+        return valid;
+    }
+
+    inline
+    void DecodeImage(const InImageDataSource& source, DecodedImage& image)
+    {
+        int32_t width = 0, height = 0, channels = 0;
+        std::visit(OverloadSet {
+            [&](const InImageFileURI& uri) {
+                image.owned = stbi_load(uri.uri.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+            },
+            [&](const InImageFileBuffer& buffer) {
+                image.owned = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(buffer.data.begin), int32_t(buffer.data.count),
+                    &width, &height, &channels, STBI_rgb_alpha);
+            },
+            [&](const InImageBuffer& buffer) {
+                if (IsFloatFormat(buffer.format)) {
+                    return;
+                }
+                image.pixels = reinterpret_cast<const uint8_t*>(buffer.data.begin);
+                image.size = buffer.size;
+                image.channels = GetChannelCount(buffer.format);
+            },
+        }, source);
+
+        if (image.owned) {
+            image.pixels = image.owned;
+            image.size = { uint32_t(width), uint32_t(height) };
+            image.channels = 4;
+        }
+    }
+
+    // Decodes to RGBA float. HDR files keep their range. LDR files are sRGB, they are decoded at
+    //  8 bits and linearized through the sRGB table, as stb_image would apply a 2.2 gamma curve.
+    //  Raw buffers are converted with sRGB formats linearized.
+
+    inline
+    void DecodeImageFloat(const InImageDataSource& source, DecodedImage& image)
+    {
+        auto& to_linear = SrgbTables::Get().to_linear;
+
+        auto convert_ldr = [&](const uint8_t* pixels, uint32_t channels, glm::uvec2 size, bool srgb) {
+            uint64_t pixel_count = uint64_t(size.x) * size.y;
+            image.converted.resize(pixel_count * 4);
+            for (uint64_t i = 0; i < pixel_count; ++i) {
+                for (uint32_t c = 0; c < 4; ++c) {
+                    float& value = image.converted[i * 4 + c];
+                    if (c >= channels) {
+                        value = c == 3 ? 1.f : 0.f;
+                    } else {
+                        uint8_t code = pixels[i * channels + c];
+                        value = srgb && c < 3 ? to_linear[code] : float(code) / 255.f;
+                    }
+                }
             }
+            image.float_pixels = image.converted.data();
+            image.size = size;
         };
 
-        struct Rgba8 { uint8_t r, g, b, a; };
+        int32_t width = 0, height = 0, channels = 0;
+
+        auto convert_file = [&](stbi_uc* pixels) {
+            if (pixels) {
+                convert_ldr(pixels, 4, { uint32_t(width), uint32_t(height) }, true);
+                stbi_image_free(pixels);
+            }
+        };
+
+        std::visit(OverloadSet {
+            [&](const InImageFileURI& uri) {
+                if (stbi_is_hdr(uri.uri.c_str())) {
+                    image.owned_float = stbi_loadf(uri.uri.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+                } else {
+                    convert_file(stbi_load(uri.uri.c_str(), &width, &height, &channels, STBI_rgb_alpha));
+                }
+            },
+            [&](const InImageFileBuffer& buffer) {
+                auto data = reinterpret_cast<const stbi_uc*>(buffer.data.begin);
+                auto size = int32_t(buffer.data.count);
+                if (stbi_is_hdr_from_memory(data, size)) {
+                    image.owned_float = stbi_loadf_from_memory(data, size, &width, &height, &channels, STBI_rgb_alpha);
+                } else {
+                    convert_file(stbi_load_from_memory(data, size, &width, &height, &channels, STBI_rgb_alpha));
+                }
+            },
+            [&](const InImageBuffer& buffer) {
+                if (buffer.format != TextureFormat::RGBA16_SFLOAT) {
+                    convert_ldr(reinterpret_cast<const uint8_t*>(buffer.data.begin), GetChannelCount(buffer.format),
+                        buffer.size, buffer.format == TextureFormat::RGBA8_SRGB);
+                    return;
+                }
+
+                uint64_t pixel_count = uint64_t(buffer.size.x) * buffer.size.y;
+                image.converted.resize(pixel_count * 4);
+                for (uint64_t i = 0; i < pixel_count * 4; ++i) {
+                    uint16_t half;
+                    std::memcpy(&half, &buffer.data[i * 2], 2);
+                    image.converted[i] = HalfToFloat(half);
+                }
+                image.float_pixels = image.converted.data();
+                image.size = buffer.size;
+            },
+        }, source);
+
+        if (image.owned_float) {
+            image.float_pixels = image.owned_float;
+            image.size = { uint32_t(width), uint32_t(height) };
+        }
+    }
+
+    // Describes why a source failed to decode. stb_image only reports on encoded files, raw
+    //  pixel buffers are rejected by their layout.
+
+    inline
+    const char* GetDecodeFailureReason(const InImageDataSource& source, bool valid)
+    {
+        if (auto* buffer = std::get_if<InImageBuffer>(&source)) {
+            if (IsBlockCompressed(buffer->format)) {
+                return "block compressed pixel buffers can not be decoded";
+            }
+            if (buffer->data.count < uint64_t(buffer->size.x) * buffer->size.y * GetBlockBytes(buffer->format)) {
+                return "pixel buffer is smaller than its size and format";
+            }
+            if (IsFloatFormat(buffer->format)) {
+                return "float pixel buffer used by an 8 bit texture";
+            }
+            return "empty pixel buffer";
+        }
+
+        if (!valid) {
+            return "unsupported image";
+        }
+        auto reason = stbi_failure_reason();
+        return reason ? reason : "unknown error";
+    }
+
+    // Textures with at least this many pixels in a group of connected sources are written
+    //  one group at a time with parallelism over rows, smaller groups in parallel
+
+    constexpr uint64_t ParallelTexturePixelThreshold = 1 << 20;
+
+    inline
+    void ProcessMaterials(Importer& importer, Scene& scene)
+    {
+        auto& memory_pool = importer.memory_pool;
+        auto& settings = importer.settings;
+        auto& textures = importer.textures;
+        auto& materials = importer.materials;
 
-        std::vector<LoadedTexture> loaded_textures(textures.size());
+        using namespace std::chrono;
+        auto start = steady_clock::now();
 
-#pragma omp parallel for
-        for (uint32_t i = 0; i < textures.size(); ++i) {
-            auto& texture = textures[i];
-            auto& loaded_texture = loaded_textures[i];
+        // Resolve sources referenced by materials to the first source with identical content
 
-            if (auto uri = std::get_if<InImageFileURI>(&texture.data)) {
-                int32_t width, height, channels;
-                auto data = stbi_load(uri->uri.c_str(), &width, &height, &channels, STBI_rgb_alpha);
-                auto* pixels = reinterpret_cast<Rgba8*>(data);
+        std::vector<int32_t> referenced;
+        ankerl::unordered_dense::map<int32_t, int32_t> canonical_sources;
 
-                loaded_texture.Resize({ uint32_t(width), uint32_t(height) });
-                for (int32_t j = 0; j < width * height; ++j) {
-                    loaded_texture.pixels[j] = {
-                        float(pixels[j].r) / 255.f,
-                        float(pixels[j].g) / 255.f,
-                        float(pixels[j].b) / 255.f,
-                        float(pixels[j].a) / 255.f,
-                    };
+        for (auto& material : materials) {
+            for (auto process : MaterialTextureProcesses) {
+                for (int32_t source : (material.*process).sources) {
+                    if (source >= 0 && source < int32_t(textures.size()) && canonical_sources.insert({ source, source }).second) {
+                        referenced.push_back(source);
+                    }
                 }
+            }
+        }
 
-                stbi_image_free(data);
+        uint32_t duplicate_source_count = 0;
+        uint64_t duplicate_source_bytes = 0;
+
+        if (settings.deduplicate_textures) {
+            std::vector<SourceContentKey> keys(referenced.size());
+            std::vector<uint8_t> hashed(referenced.size());
+
+#pragma omp parallel for schedule(dynamic)
+            for (uint32_t i = 0; i < referenced.size(); ++i) {
+                hashed[i] = HashImageSource(textures[referenced[i]].data, keys[i]);
+            }
+
+            ankerl::unordered_dense::map<SourceContentKey, int32_t, SourceContentKeyHash> first_sources;
+            for (uint32_t i = 0; i < referenced.size(); ++i) {
+                if (!hashed[i]) {
+                    continue;
+                }
+                auto[iter, inserted] = first_sources.insert({ keys[i], referenced[i] });
+                if (!inserted) {
+                    canonical_sources.at(referenced[i]) = iter->second;
+                    duplicate_source_count++;
+                    duplicate_source_bytes += keys[i].bytes;
+                }
             }
         }
 
-        ankerl::unordered_dense::map<std::pair<int32_t, int32_t>, InMaterial::TextureProcess> processes;
+        // Collect texture processes referenced by materials, these are the only sources decoded
+
+        std::vector<InMaterial::TextureProcess> processes;
+        ankerl::unordered_dense::map<TextureProcessKey, uint32_t, TextureProcessKeyHash> process_indices;
 
         scene.materials = { memory_pool.Allocate<Material>(materials.size()), materials.size() };
 
-        for (int32_t i = 0; i < materials.size(); ++i) {
+        auto add_process = [&](InMaterial::TextureProcess process) -> int32_t {
+            if (process.sources[0] < 0) {
+                return -1;
+            }
+            for (int32_t& source : process.sources) {
+                if (source >= int32_t(textures.size())) {
+                    return -1;
+                }
+                if (source >= 0) {
+                    source = canonical_sources.at(source);
+                }
+            }
+            if (process.fn) {
+                processes.push_back(std::move(process));
+                return int32_t(processes.size() - 1);
+            }
+            auto[iter, inserted] = process_indices.insert({ TextureProcessKey(process), uint32_t(processes.size()) });
+            if (inserted) {
+                processes.push_back(std::move(process));
+            }
+            return int32_t(iter->second);
+        };
+
+        for (uint32_t i = 0; i < materials.size(); ++i) {
             auto& material_in = materials[i];
             auto& material_out = scene.materials[i];
 
             material_out = {};
+            material_out.albedo_alpha_texture = add_process(material_in.basecolor_alpha);
+
+            InMaterial::TextureProcess metalness_roughness;
+            if (!settings.split_metalness_roughness
+                    && CombineChannelProcesses(material_in.metalness, material_in.roughness, metalness_roughness)) {
+                material_out.metalness_texture = material_out.roughness_texture = add_process(metalness_roughness);
+            } else {
+                material_out.metalness_texture = add_process(material_in.metalness);
+                material_out.roughness_texture = add_process(material_in.roughness);
+            }
+
+            material_out.normal_texture = add_process(material_in.normal);
+            material_out.emission_texture = add_process(material_in.emission);
+            material_out.transmission_texture = add_process(material_in.transmission);
+
+            for (uint32_t c = 0; c < 4; ++c) {
+                material_out.albedo_alpha[c] = QuantizeUNorm8(material_in.albedo_alpha_factor[c]);
+            }
+            material_out.metalness_roughness = {
+                QuantizeUNorm8(material_in.metalness_factor),
+                QuantizeUNorm8(material_in.roughness_factor),
+            };
+            for (uint32_t c = 0; c < 3; ++c) {
+                material_out.emission_factor[c] = QuantizeUNorm8(material_in.emission_factor[c]);
+            }
+            material_out.transmission_factor = QuantizeUNorm8(material_in.transmission_factor);
+        }
+
+        // Size sources from their image headers
+
+        struct SourceInfo
+        {
+            int32_t    source;
+            glm::uvec2 size = {};
+            glm::uvec2 decode_size = {};
+            bool       valid = false;
+            bool       decode_ldr = false;
+            bool       decode_hdr = false;
+            bool       srgb = true;
+        };
+
+        std::vector<SourceInfo> sources;
+        ankerl::unordered_dense::map<int32_t, uint32_t> source_indices;
+
+        for (auto& process : processes) {
+            for (int32_t source : process.sources) {
+                if (source >= 0 && source_indices.insert({ source, uint32_t(sources.size()) }).second) {
+                    sources.push_back(SourceInfo { .source = source });
+                }
+            }
+        }
+
+#pragma omp parallel for schedule(dynamic)
+        for (uint32_t i = 0; i < sources.size(); ++i) {
+            sources[i].valid = QueryImageSize(textures[sources[i].source].data, sources[i].size);
+        }
 
-            if (material_in.basecolor_alpha.source != -1) {
-                processes.insert({ std::make_pair(material_in.basecolor_alpha.source, 0), material_in.basecolor_alpha });
+        // Textures are downscaled a mip level at a time, first to their max size, then from the
+        //  largest texture down until all fit the VRAM budget
+
+        auto get_format = [&](const InMaterial::TextureProcess& process) {
+            return settings.compress_textures ? GetCompressedFormat(process.format) : process.format;
+        };
+
+        auto get_source_size = [&](const InMaterial::TextureProcess& process) {
+            return sources[source_indices.at(process.sources[0])].size;
+        };
+
+        auto get_mip_count = [&](glm::uvec2 size) {
+            return settings.generate_texture_mips ? std::max(GetMipCount(size), 1u) : 1;
+        };
+
+        std::vector<uint32_t> levels(processes.size(), 0);
+
+        auto get_texture_bytes = [&](uint32_t p) {
+            auto size = GetMipSize(get_source_size(processes[p]), levels[p]);
+            return GetTextureBytes(size, get_format(processes[p]), get_mip_count(size));
+        };
+
+        uint64_t full_bytes = 0;
+        uint64_t total_bytes = 0;
+
+        for (uint32_t p = 0; p < processes.size(); ++p) {
+            auto& process = processes[p];
+            full_bytes += get_texture_bytes(p);
+
+            uint32_t max_size = settings.max_texture_size;
+            if (process.max_size) {
+                max_size = max_size ? std::min(max_size, process.max_size) : process.max_size;
             }
 
-            material_out.albedo_alpha_texture = material_in.basecolor_alpha.source;
+            auto source_size = get_source_size(process);
+            while (max_size && levels[p] + 1 < GetMipCount(source_size)) {
+                auto size = GetMipSize(source_size, levels[p]);
+                if (std::max(size.x, size.y) <= max_size) {
+                    break;
+                }
+                levels[p]++;
+            }
+            total_bytes += get_texture_bytes(p);
+        }
+
+        if (settings.texture_vram_budget) {
+            std::priority_queue<std::pair<uint64_t, uint32_t>> largest;
+            for (uint32_t p = 0; p < processes.size(); ++p) {
+                largest.push({ get_texture_bytes(p), p });
+            }
+
+            while (total_bytes > settings.texture_vram_budget && !largest.empty()) {
+                auto[bytes, p] = largest.top();
+                largest.pop();
+                if (levels[p] + 1 >= GetMipCount(get_source_size(processes[p]))) {
+                    continue;
+                }
+                levels[p]++;
+                uint64_t new_bytes = get_texture_bytes(p);
+                total_bytes -= bytes - new_bytes;
+                largest.push({ new_bytes, p });
+            }
         }
 
         scene.textures = { memory_pool.Allocate<Texture>(processes.size()), processes.size() };
 
-        uint32_t texture_idx = 0;
-        for (auto&[key, process] : processes) {
-            auto& texture_out = scene.textures[texture_idx];
-            auto& texture_in = loaded_textures[process.source];
-
-            auto size = texture_in.size;
-            texture_out.size = size;
-            texture_out.format = process.format;
-
-            auto pixel_stride = 0;
-            auto channels = 0;
-            switch (process.format) {
-                    using enum TextureFormat;
-                break;case RGBA8_UNORM:
-                      case RGBA8_SRGB:
-                    pixel_stride = 4;
-                    channels = 4;
-                break;case RG8_UNORM:
-                    pixel_stride = 2;
-                    channels = 2;
-                break;case R8_UNORM:
-                    pixel_stride = 1;
-                    channels = 1;
-                break;default:
-                    std::unreachable();
-            }
-
-            auto byte_size = size.x * size.y * pixel_stride;
+        uint32_t downscaled_count = 0;
+
+        for (uint32_t p = 0; p < processes.size(); ++p) {
+            auto& process = processes[p];
+            auto& texture_out = scene.textures[p];
+
+            texture_out = {};
+            texture_out.size = GetMipSize(get_source_size(process), levels[p]);
+            texture_out.format = get_format(process);
+            texture_out.mip_count = get_mip_count(texture_out.size);
 
+            uint64_t byte_size = LayoutTexture(memory_pool, texture_out);
             texture_out.data = { memory_pool.Allocate<std::byte>(byte_size), byte_size };
 
-            for (uint32_t y = 0; y < texture_in.size.y; ++y) {
-                for (uint32_t x = 0; x < texture_in.size.x; ++x) {
-                    uint8_t* pixel = reinterpret_cast<uint8_t*>(&texture_out.data[(x + y * size.x) * pixel_stride]);
-                    auto res = process.fn(texture_in.Get({ uint32_t(x), uint32_t(y) }));
-                    for (int32_t i = 0; i < channels; ++i) {
-                        pixel[i] = uint8_t(res[i] * 255.f);
+            downscaled_count += levels[p] > 0;
+
+            // HDR textures read their sources as float. Sources are decoded at the largest size
+            //  of the textures reading them.
+
+            for (int32_t source : process.sources) {
+                if (source >= 0) {
+                    auto& info = sources[source_indices.at(source)];
+                    (IsFloatFormat(texture_out.format) ? info.decode_hdr : info.decode_ldr) = true;
+                    info.srgb &= GetProcessFormat(texture_out.format) == TextureFormat::RGBA8_SRGB;
+                    info.decode_size = glm::uvec2(
+                        std::max(info.decode_size.x, texture_out.size.x),
+                        std::max(info.decode_size.y, texture_out.size.y));
+                }
+            }
+        }
+
+        // Sources merged by one process must be decoded at the same size
+
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (auto& process : processes) {
+                glm::uvec2 size = {};
+                for (int32_t source : process.sources) {
+                    if (source >= 0) {
+                        auto& decode_size = sources[source_indices.at(source)].decode_size;
+                        size = glm::uvec2(std::max(size.x, decode_size.x), std::max(size.y, decode_size.y));
+                    }
+                }
+                for (int32_t source : process.sources) {
+                    if (source >= 0) {
+                        auto& decode_size = sources[source_indices.at(source)].decode_size;
+                        changed |= decode_size != size;
+                        decode_size = size;
+                    }
+                }
+            }
+        }
+
+        // Block compressed textures are processed into an 8 bit mip chain first, HDR textures
+        //  always into an RGBA float chain
+
+        auto get_scratch_bytes = [&](const Texture& texture) -> uint64_t {
+            if (IsFloatFormat(texture.format)) {
+                return GetMipChainBytes(texture.size, texture.mip_count, 4 * sizeof(float));
+            }
+            if (!IsBlockCompressed(texture.format)) {
+                return 0;
+            }
+            return GetMipChainBytes(texture.size, texture.mip_count, GetChannelCount(texture.format));
+        };
+
+        // Textures smaller than their decoded sources are written at the decoded size, then
+        //  resampled down
+
+        auto get_kernel_size = [&](const InMaterial::TextureProcess& process) {
+            return sources[source_indices.at(process.sources[0])].decode_size;
+        };
+
+        auto get_resample_bytes = [&](uint32_t p) -> uint64_t {
+            auto& texture = scene.textures[p];
+            auto size = get_kernel_size(processes[p]);
+            if (size == texture.size) {
+                return 0;
+            }
+            uint32_t pixel_bytes = IsFloatFormat(texture.format) ? 4 * sizeof(float) : GetChannelCount(texture.format);
+            return uint64_t(size.x) * size.y * pixel_bytes;
+        };
+
+        // Float rows held by the resampler while a texture is resampled down and its mips are
+        //  generated, one after the other
+
+        auto get_resample_working_bytes = [&](uint32_t p, uint32_t threads) -> uint64_t {
+            auto& texture = scene.textures[p];
+            uint32_t channels = IsFloatFormat(texture.format) ? 4 : GetChannelCount(GetProcessFormat(texture.format));
+            auto size = get_kernel_size(processes[p]);
+            uint64_t bytes = 0;
+            if (size != texture.size) {
+                bytes = GetResampleWorkingBytes(size, texture.size, channels, settings.texture_resize_filter, threads);
+            }
+            if (texture.mip_count > 1) {
+                bytes = std::max(bytes, GetMipWorkingBytes(texture.size, channels, settings.texture_mip_filter, threads));
+            }
+            return bytes;
+        };
+
+        // Group sources connected through processes, so each source is decoded once and all
+        //  processes merging it are written while it is resident
+
+        std::vector<uint32_t> parents(sources.size());
+        std::iota(parents.begin(), parents.end(), 0);
+
+        auto find_root = [&](uint32_t i) {
+            while (parents[i] != i) {
+                i = parents[i] = parents[parents[i]];
+            }
+            return i;
+        };
+
+        for (auto& process : processes) {
+            uint32_t root = find_root(source_indices.at(process.sources[0]));
+            for (int32_t source : process.sources) {
+                if (source >= 0) {
+                    parents[find_root(source_indices.at(source))] = root;
+                }
+            }
+        }
+
+        struct SourceGroup
+        {
+            std::vector<uint32_t> sources;
+            std::vector<uint32_t> processes;
+            uint64_t              pixels = 0;
+            uint64_t              decoded_bytes = 0;
+            uint64_t              scratch_bytes = 0;
+        };
+
+        std::vector<SourceGroup> groups;
+        std::vector<uint32_t> group_indices(sources.size(), UINT32_MAX);
+
+        for (uint32_t i = 0; i < sources.size(); ++i) {
+            auto& group_idx = group_indices[find_root(i)];
+            if (group_idx == UINT32_MAX) {
+                group_idx = uint32_t(groups.size());
+                groups.emplace_back();
+            }
+            uint64_t pixels = uint64_t(sources[i].size.x) * sources[i].size.y;
+            groups[group_idx].sources.push_back(i);
+            groups[group_idx].pixels += pixels;
+            groups[group_idx].decoded_bytes += pixels * ((sources[i].decode_ldr ? 4 : 0) + (sources[i].decode_hdr ? 4 * sizeof(float) : 0));
+
+            // Downscaled sources hold their reduced copy alongside the full decode briefly
+
+            if (sources[i].decode_size != sources[i].size) {
+                uint64_t decode_pixels = uint64_t(sources[i].decode_size.x) * sources[i].decode_size.y;
+                groups[group_idx].decoded_bytes += decode_pixels * ((sources[i].decode_ldr ? 4 : 0) + (sources[i].decode_hdr ? 4 * sizeof(float) : 0));
+            }
+        }
+
+        // Groups run on all threads when large enough, the resampler's rows scale with them
+
+        auto get_group_threads = [&](const SourceGroup& group) -> uint32_t {
+            return group.pixels >= ParallelTexturePixelThreshold ? uint32_t(omp_get_max_threads()) : 1;
+        };
+
+        for (uint32_t i = 0; i < sources.size(); ++i) {
+            auto& source = sources[i];
+            if (!source.valid || source.decode_size == source.size) {
+                continue;
+            }
+            auto& group = groups[group_indices[find_root(i)]];
+            group.scratch_bytes = std::max(group.scratch_bytes,
+                GetResampleWorkingBytes(source.size, source.decode_size, 4, settings.texture_resize_filter, get_group_threads(group)));
+        }
+
+        for (uint32_t p = 0; p < processes.size(); ++p) {
+            auto& group = groups[group_indices[find_root(source_indices.at(processes[p].sources[0]))]];
+            group.processes.push_back(p);
+            group.scratch_bytes = std::max(group.scratch_bytes, get_scratch_bytes(scene.textures[p]) + get_resample_bytes(p)
+                + get_resample_working_bytes(p, get_group_threads(group)));
+        }
+
+        // Decodes a group's sources and writes its processes with compiled channel kernels.
+        //  Decoded images are released as soon as the group is written.
+
+        auto process_group = [&](const SourceGroup& group, bool parallel) -> uint32_t {
+            std::vector<DecodedImage> images(group.sources.size());
+
+            uint32_t failed_count = 0;
+
+#pragma omp parallel for schedule(dynamic) if(parallel) reduction(+: failed_count)
+            for (uint32_t i = 0; i < group.sources.size(); ++i) {
+                auto& source = sources[group.sources[i]];
+                if (source.valid && source.decode_ldr) {
+                    DecodeImage(textures[source.source].data, images[i]);
+                }
+                if (source.valid && source.decode_hdr) {
+                    DecodeImageFloat(textures[source.source].data, images[i]);
+                }
+                if ((source.decode_ldr && !images[i].pixels) || (source.decode_hdr && !images[i].float_pixels)) {
+                    fmt::println("Failed to decode texture {}: {}", source.source, GetDecodeFailureReason(textures[source.source].data, source.valid));
+                    failed_count++;
+                }
+            }
+
+            for (uint32_t i = 0; i < group.sources.size(); ++i) {
+                auto& source = sources[group.sources[i]];
+                if (images[i].pixels || images[i].float_pixels) {
+                    DownscaleImage(images[i], source.decode_size, settings.texture_resize_filter, source.srgb, parallel);
+                }
+            }
+
+            for (uint32_t p : group.processes) {
+                auto& process = processes[p];
+                auto& texture_out = scene.textures[p];
+
+                std::array<ChannelSource, 4> inputs;
+                std::array<FloatChannelSource, 4> float_inputs;
+                for (uint32_t k = 0; k < 4; ++k) {
+                    if (process.sources[k] < 0) {
+                        continue;
+                    }
+                    uint32_t source_idx = source_indices.at(process.sources[k]);
+                    auto& image = images[std::find(group.sources.begin(), group.sources.end(), source_idx) - group.sources.begin()];
+                    inputs[k] = ChannelSource { image.pixels, image.size, image.channels };
+                    float_inputs[k] = FloatChannelSource { image.float_pixels, image.size, 4 };
+                }
+
+                auto kernel_size = get_kernel_size(process);
+
+                if (IsFloatFormat(texture_out.format)) {
+                    FloatChannelKernel kernel;
+                    if (!kernel.Compile(process, float_inputs, kernel_size)) {
+                        std::memset(texture_out.data.begin, 0, texture_out.data.count);
+                        continue;
                     }
+
+                    std::vector<float> scratch(get_scratch_bytes(texture_out) / sizeof(float));
+                    if (kernel_size == texture_out.size) {
+                        kernel.RunRows(texture_out.size, scratch.data(), parallel);
+                    } else {
+                        std::vector<float> full(get_resample_bytes(p) / sizeof(float));
+                        kernel.RunRows(kernel_size, full.data(), parallel);
+                        ResampleImage(full.data(), kernel_size, scratch.data(), texture_out.size, 4, settings.texture_resize_filter, false, parallel);
+                    }
+
+                    if (texture_out.mip_count > 1) {
+                        GenerateMips(scratch.data(), texture_out.size, 4, settings.texture_mip_filter, false, parallel);
+                    }
+
+                    if (IsBlockCompressed(texture_out.format)) {
+                        uint64_t level_offset = 0;
+                        for (uint32_t level = 0; level < texture_out.mip_count; ++level) {
+                            auto level_size = GetMipSize(texture_out.size, level);
+                            CompressImage(scratch.data() + level_offset, level_size, texture_out.format, settings.texture_compression_quality,
+                                &texture_out.data[texture_out.mip_offsets[level]], parallel);
+                            level_offset += uint64_t(level_size.x) * level_size.y * 4;
+                        }
+                    } else {
+                        ConvertToHalf(scratch.data(), scratch.size(), texture_out.data.begin, parallel);
+                    }
+
+                    continue;
+                }
+
+                ChannelKernel kernel;
+                if (!kernel.Compile(process, inputs, kernel_size)) {
+                    std::memset(texture_out.data.begin, 0, texture_out.data.count);
+                    continue;
+                }
+
+                bool compressed = IsBlockCompressed(texture_out.format);
+                auto process_format = GetProcessFormat(texture_out.format);
+                uint32_t channels = GetChannelCount(process_format);
+
+                std::vector<uint8_t> scratch(get_scratch_bytes(texture_out));
+                auto* out = compressed ? scratch.data() : reinterpret_cast<uint8_t*>(texture_out.data.begin);
+
+                if (kernel_size == texture_out.size) {
+                    kernel.RunRows(texture_out.size, out, parallel);
+                } else {
+                    std::vector<uint8_t> full(get_resample_bytes(p));
+                    kernel.RunRows(kernel_size, full.data(), parallel);
+                    ResampleImage(full.data(), kernel_size, out, texture_out.size, channels, settings.texture_resize_filter,
+                        process_format == TextureFormat::RGBA8_SRGB, parallel);
+                }
+
+                if (texture_out.mip_count > 1) {
+                    GenerateMips(out, texture_out.size, channels, settings.texture_mip_filter,
+                        process_format == TextureFormat::RGBA8_SRGB, parallel);
+                }
+
+                if (compressed) {
+                    uint64_t level_offset = 0;
+                    for (uint32_t level = 0; level < texture_out.mip_count; ++level) {
+                        auto level_size = GetMipSize(texture_out.size, level);
+                        CompressImage(out + level_offset, level_size, texture_out.format, settings.texture_compression_quality,
+                            &texture_out.data[texture_out.mip_offsets[level]], parallel);
+                        level_offset += uint64_t(level_size.x) * level_size.y * channels;
+                    }
+                }
+            }
+
+            return failed_count;
+        };
+
+        // Process groups in waves whose decoded and scratch size fits the working set budget
+
+        uint64_t budget = settings.texture_memory_budget ? settings.texture_memory_budget : UINT64_MAX;
+        uint64_t max_wave_bytes = 0;
+        uint32_t wave_count = 0;
+        uint32_t failed_count = 0;
+
+        auto decoded_bytes = [](const SourceGroup& group) {
+            return group.decoded_bytes + group.scratch_bytes;
+        };
+
+        for (uint32_t first = 0; first < groups.size();) {
+            uint32_t last = first;
+            uint64_t wave_bytes = 0;
+            while (last < groups.size() && (last == first || wave_bytes + decoded_bytes(groups[last]) <= budget)) {
+                wave_bytes += decoded_bytes(groups[last++]);
+            }
+
+#pragma omp parallel for schedule(dynamic) reduction(+: failed_count)
+            for (uint32_t i = first; i < last; ++i) {
+                if (groups[i].pixels < ParallelTexturePixelThreshold) {
+                    failed_count += process_group(groups[i], false);
                 }
             }
 
-            texture_idx++;
+            for (uint32_t i = first; i < last; ++i) {
+                if (groups[i].pixels >= ParallelTexturePixelThreshold) {
+                    failed_count += process_group(groups[i], true);
+                }
+            }
+
+            max_wave_bytes = std::max(max_wave_bytes, wave_bytes);
+            wave_count++;
+            first = last;
+        }
+
+        auto end = steady_clock::now();
+
+        uint32_t hdr_count = 0;
+        for (uint32_t i = 0; i < scene.textures.count; ++i) {
+            hdr_count += IsFloatFormat(scene.textures[i].format);
+        }
+
+        fmt::println("Processed {} textures ({} HDR) from {} of {} sources ({} failed, {} duplicates of {} bytes skipped) in {} waves, max decoded working set {} bytes, in {} ms",
+            processes.size(), hdr_count, sources.size(), textures.size(), failed_count, duplicate_source_count, duplicate_source_bytes, wave_count, max_wave_bytes,
+            duration_cast<milliseconds>(end - start).count());
+
+        if (downscaled_count) {
+            fmt::println("Downscaled {} textures to fit max size and VRAM budget, {} -> {} bytes",
+                downscaled_count, full_bytes, total_bytes);
         }
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,349 @@
+#pragma once
+
+#include <imp/imp_Importer.hpp>
+
+namespace imp::detail
+{
+    // Positions are snapped to a single grid shared by all geometry, so any two vertices with
+    //  the same position quantize to the same grid point regardless of the range or meshlet
+    //  that they belong to. Only the origin the offsets are stored against differs.
+    //
+    // Grid points are held relative to a 64 bit per page origin, so large absolute
+    //  coordinates (e.g. geospatial data) only need the extent of a page to fit 32 bits.
+
+    struct PositionGrid
+    {
+        double        step;
+        Vec3<int64_t> origin = {};
+
+        Vec3<int32_t> Snap(glm::vec3 position) const noexcept
+        {
+            Vec3<int32_t> point;
+            for (uint32_t k = 0; k < 3; ++k) {
+                point[k] = int32_t(int64_t(std::round(double(position[k]) / step)) - origin[k]);
+            }
+            return point;
+        }
+    };
+
+    // Float bounds of the vertices of a range, used to place the page grid origin and to
+    //  validate the page before any point is snapped
+
+    struct PositionBounds
+    {
+        glm::vec3 min { FLT_MAX };
+        glm::vec3 max { -FLT_MAX };
+        bool      finite = true;
+
+        void Expand(const glm::vec3& position) noexcept
+        {
+            finite &= std::isfinite(position.x) && std::isfinite(position.y) && std::isfinite(position.z);
+            min = glm::min(min, position);
+            max = glm::max(max, position);
+        }
+
+        void Expand(const PositionBounds& other) noexcept
+        {
+            finite &= other.finite;
+            min = glm::min(min, other.min);
+            max = glm::max(max, other.max);
+        }
+    };
+
+    struct GridBounds
+    {
+        Vec3<int32_t> min { INT32_MAX, INT32_MAX, INT32_MAX };
+        Vec3<int32_t> max { INT32_MIN, INT32_MIN, INT32_MIN };
+
+        void Expand(const Vec3<int32_t>& point) noexcept
+        {
+            for (uint32_t k = 0; k < 3; ++k) {
+                min[k] = std::min(min[k], point[k]);
+                max[k] = std::max(max[k], point[k]);
+            }
+        }
+
+        int64_t MaxExtent() const noexcept
+        {
+            int64_t extent = 0;
+            for (uint32_t k = 0; k < 3; ++k) {
+                extent = std::max(extent, int64_t(max[k]) - int64_t(min[k]));
+            }
+            return extent;
+        }
+    };
+
+    template<class T>
+    Vec3<T> GridOffset(const Vec3<int32_t>& point, const Vec3<int32_t>& origin) noexcept
+    {
+        return {
+            T(int64_t(point[0]) - origin[0]),
+            T(int64_t(point[1]) - origin[1]),
+            T(int64_t(point[2]) - origin[2]),
+        };
+    }
+
+    // Largest extent in grid steps of the meshlets (or clusters) of a range
+
+    inline
+    int64_t GetMeshletGridExtent(
+        const PositionGrid& grid, const Geometry& geometry, const GeometryRange& range,
+        Range<Meshlet> meshlets, Range<uint32_t> meshlet_vertices, uint32_t first, uint32_t count)
+    {
+        int64_t extent = 0;
+        for (uint32_t j = first; j < first + count; ++j) {
+            auto& meshlet = meshlets[j];
+            GridBounds bounds;
+            for (uint32_t v = 0; v < meshlet.vertex_count; ++v) {
+                bounds.Expand(grid.Snap(geometry.positions[range.vertex_offset + meshlet_vertices[meshlet.vertex_offset + v]]));
+            }
+            extent = std::max(extent, bounds.MaxExtent());
+        }
+        return extent;
+    }
+
+    inline
+    uint32_t GetPositionSize(PositionFormat format)
+    {
+        switch (format) {
+            break;case PositionFormat::UInt16: return sizeof(Vec3<uint16_t>);
+            break;case PositionFormat::UInt32: return sizeof(Vec3<uint32_t>);
+        }
+        std::unreachable();
+    }
+
+    inline
+    void WritePositionOffset(std::byte* out, PositionFormat format, const Vec3<int32_t>& point, const Vec3<int32_t>& origin) noexcept
+    {
+        switch (format) {
+            break;case PositionFormat::UInt16: {
+                auto offset = GridOffset<uint16_t>(point, origin);
+                std::memcpy(out, &offset, sizeof(offset));
+            }
+            break;case PositionFormat::UInt32: {
+                auto offset = GridOffset<uint32_t>(point, origin);
+                std::memcpy(out, &offset, sizeof(offset));
+            }
+        }
+    }
+
+    // Meshlet (or cluster) vertices of a range are contiguous, starting at the vertex_offset
+    //  of its first meshlet
+
+    inline
+    uint32_t GetMeshletVertexCount(Range<Meshlet> meshlets, uint32_t first, uint32_t count) noexcept
+    {
+        if (!count) {
+            return 0;
+        }
+        auto& last = meshlets[first + count - 1];
+        return last.vertex_offset + last.vertex_count - meshlets[first].vertex_offset;
+    }
+
+    // Quantizes the vertices of a set of meshlets (or clusters) against per meshlet origins,
+    //  packed per range at the width of its position format
+
+    inline
+    void QuantizeMeshletPositions(
+        const PositionGrid& grid, Geometry& geometry, Range<GeometryRange> ranges,
+        Range<Meshlet> meshlets, Range<uint32_t> meshlet_vertices,
+        Range<Vec3<int32_t>> origins, Range<std::byte> offsets,
+        uint32_t GeometryRange::* first, uint32_t GeometryRange::* count, uint64_t GeometryRange::* byte_offset)
+    {
+#pragma omp parallel for schedule(dynamic)
+        for (uint32_t i = 0; i < ranges.count; ++i) {
+            auto& range = ranges[i];
+            if (!(range.*count)) {
+                continue;
+            }
+
+            uint32_t position_size = GetPositionSize(range.position_format);
+            uint32_t base_vertex = meshlets[range.*first].vertex_offset;
+
+            for (uint32_t j = range.*first; j < range.*first + range.*count; ++j) {
+                auto& meshlet = meshlets[j];
+
+                auto point = [&](uint32_t local) {
+                    return grid.Snap(geometry.positions[range.vertex_offset + meshlet_vertices[meshlet.vertex_offset + local]]);
+                };
+
+                GridBounds bounds;
+                for (uint32_t v = 0; v < meshlet.vertex_count; ++v) {
+                    bounds.Expand(point(v));
+                }
+
+                origins[j] = bounds.min;
+                auto* out = &offsets[range.*byte_offset + uint64_t(meshlet.vertex_offset - base_vertex) * position_size];
+                for (uint32_t v = 0; v < meshlet.vertex_count; ++v) {
+                    WritePositionOffset(out + uint64_t(v) * position_size, range.position_format, point(v), bounds.min);
+                }
+            }
+        }
+    }
+
+    inline
+    void QuantizePositions(Importer& importer, Scene& scene)
+    {
+        auto& memory_pool = importer.memory_pool;
+        auto& settings = importer.settings;
+
+        if (!(settings.position_grid_step > 0.f)) {
+            Error("Invalid position grid step: {}", settings.position_grid_step);
+        }
+
+        using namespace std::chrono;
+        auto start = steady_clock::now();
+
+        PositionGrid grid { .step = settings.position_grid_step };
+
+        uint64_t position_bytes = 0;
+        uint64_t quantized_bytes = 0;
+        uint32_t wide_range_count = 0;
+
+        for (uint32_t p = 0; p < scene.geometries.count; ++p) {
+            auto& geometry = scene.geometries[p];
+            auto ranges = scene.geometry_ranges.Slice(geometry.first_range, geometry.range_count);
+
+            geometry.position_grid_step = settings.position_grid_step;
+            position_bytes += geometry.positions.count * sizeof(glm::vec3);
+
+            bool meshlet_relative = geometry.meshlets.count || geometry.clusters.count;
+
+            // Place the grid origin for the page, reporting pages whose grid points can't be
+            //  represented before any are snapped
+
+            std::vector<PositionBounds> range_position_bounds(ranges.count);
+
+#pragma omp parallel for schedule(dynamic)
+            for (uint32_t i = 0; i < ranges.count; ++i) {
+                auto& range = ranges[i];
+                for (uint32_t v = 0; v < range.max_vertex + 1; ++v) {
+                    range_position_bounds[i].Expand(geometry.positions[range.vertex_offset + v]);
+                }
+            }
+
+            PositionBounds page_bounds;
+            for (auto& bounds : range_position_bounds) {
+                page_bounds.Expand(bounds);
+            }
+
+            if (!page_bounds.finite) {
+                Error("Geometry page {} contains non-finite positions", p);
+            }
+
+            grid.origin = {};
+            if (page_bounds.min.x <= page_bounds.max.x) {
+                for (uint32_t k = 0; k < 3; ++k) {
+                    double low = std::round(double(page_bounds.min[k]) / grid.step);
+                    double high = std::round(double(page_bounds.max[k]) / grid.step);
+                    if (std::abs(low) > 0x1p62 || std::abs(high) > 0x1p62 || high - low > double(INT32_MAX)) {
+                        Error("Geometry page {} spans ({}, {}, {}) to ({}, {}, {}), too far for position grid step {}",
+                            p, page_bounds.min.x, page_bounds.min.y, page_bounds.min.z,
+                            page_bounds.max.x, page_bounds.max.y, page_bounds.max.z, grid.step);
+                    }
+                    grid.origin[k] = int64_t(low);
+                }
+            }
+
+            geometry.position_grid_origin = grid.origin;
+
+            // Ranges spanning more grid steps than 16 bit offsets can hold fall back to 32 bit
+            //  offsets for all of their vertices, meshlets and clusters
+
+            std::vector<GridBounds> range_bounds(ranges.count);
+            uint32_t wide_count = 0;
+
+#pragma omp parallel for schedule(dynamic) reduction(+: wide_count)
+            for (uint32_t i = 0; i < ranges.count; ++i) {
+                auto& range = ranges[i];
+                int64_t extent = 0;
+                if (meshlet_relative) {
+                    extent = std::max(
+                        GetMeshletGridExtent(grid, geometry, range, geometry.meshlets, geometry.meshlet_vertices,
+                            range.first_meshlet, range.meshlet_count),
+                        GetMeshletGridExtent(grid, geometry, range, geometry.clusters, geometry.cluster_vertices,
+                            range.first_cluster, range.cluster_count));
+                } else {
+                    for (uint32_t v = 0; v < range.max_vertex + 1; ++v) {
+                        range_bounds[i].Expand(grid.Snap(geometry.positions[range.vertex_offset + v]));
+                    }
+                    extent = range_bounds[i].MaxExtent();
+                }
+
+                range.position_format = extent > UINT16_MAX ? PositionFormat::UInt32 : PositionFormat::UInt16;
+                wide_count += range.position_format == PositionFormat::UInt32;
+            }
+
+            wide_range_count += wide_count;
+
+            // Pack offsets per range at the width of its format, so ranges falling back to
+            //  32 bits don't widen the rest of the page
+
+            if (meshlet_relative) {
+
+                // Meshlet relative, origins only need to cover a single meshlet
+
+                uint64_t meshlet_position_bytes = 0;
+                uint64_t cluster_position_bytes = 0;
+                for (uint32_t i = 0; i < ranges.count; ++i) {
+                    auto& range = ranges[i];
+                    uint32_t position_size = GetPositionSize(range.position_format);
+                    range.meshlet_position_byte_offset = meshlet_position_bytes;
+                    range.cluster_position_byte_offset = cluster_position_bytes;
+                    meshlet_position_bytes += uint64_t(GetMeshletVertexCount(geometry.meshlets, range.first_meshlet, range.meshlet_count)) * position_size;
+                    cluster_position_bytes += uint64_t(GetMeshletVertexCount(geometry.clusters, range.first_cluster, range.cluster_count)) * position_size;
+                }
+
+                geometry.meshlet_position_origins = { memory_pool.Allocate<Vec3<int32_t>>(geometry.meshlets.count), geometry.meshlets.count };
+                geometry.meshlet_positions = { memory_pool.Allocate<std::byte>(meshlet_position_bytes), meshlet_position_bytes };
+                geometry.cluster_position_origins = { memory_pool.Allocate<Vec3<int32_t>>(geometry.clusters.count), geometry.clusters.count };
+                geometry.cluster_positions = { memory_pool.Allocate<std::byte>(cluster_position_bytes), cluster_position_bytes };
+
+                QuantizeMeshletPositions(grid, geometry, ranges,
+                    geometry.meshlets, geometry.meshlet_vertices,
+                    geometry.meshlet_position_origins, geometry.meshlet_positions,
+                    &GeometryRange::first_meshlet, &GeometryRange::meshlet_count, &GeometryRange::meshlet_position_byte_offset);
+                QuantizeMeshletPositions(grid, geometry, ranges,
+                    geometry.clusters, geometry.cluster_vertices,
+                    geometry.cluster_position_origins, geometry.cluster_positions,
+                    &GeometryRange::first_cluster, &GeometryRange::cluster_count, &GeometryRange::cluster_position_byte_offset);
+
+                quantized_bytes += meshlet_position_bytes + cluster_position_bytes
+                    + (geometry.meshlet_position_origins.count + geometry.cluster_position_origins.count) * sizeof(Vec3<int32_t>);
+            } else {
+
+                // Range relative
+
+                uint64_t offset_bytes = 0;
+                for (uint32_t i = 0; i < ranges.count; ++i) {
+                    auto& range = ranges[i];
+                    range.position_byte_offset = offset_bytes;
+                    offset_bytes += uint64_t(range.max_vertex + 1) * GetPositionSize(range.position_format);
+                }
+
+                geometry.quantized_positions = { memory_pool.Allocate<std::byte>(offset_bytes), offset_bytes };
+
+#pragma omp parallel for schedule(dynamic)
+                for (uint32_t i = 0; i < ranges.count; ++i) {
+                    auto& range = ranges[i];
+                    auto& bounds = range_bounds[i];
+                    uint32_t position_size = GetPositionSize(range.position_format);
+
+                    range.position_origin = bounds.min;
+                    for (uint32_t v = 0; v < range.max_vertex + 1; ++v) {
+                        WritePositionOffset(&geometry.quantized_positions[range.position_byte_offset + uint64_t(v) * position_size],
+                            range.position_format, grid.Snap(geometry.positions[range.vertex_offset + v]), bounds.min);
+                    }
+                }
+
+                quantized_bytes += offset_bytes;
+            }
+        }
+
+        auto end = steady_clock::now();
+
+        fmt::println("Quantized positions to grid step {} ({} -> {} bytes, {} ranges with 32 bit offsets) in {} ms",
+            settings.position_grid_step, position_bytes, quantized_bytes, wide_range_count,
+            duration_cast<milliseconds>(end - start).count());
+    }
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <imp/imp_Importer.hpp>
+
+#include "imp_ProcessGeometry.hpp"
+
+namespace imp::detail
+{
+    // Upper estimate of the peak memory needed to process one geometry: input data, output
+    //  page data, the largest per stage scratch (tangent space accumulation and vertex
+    //  adjacency) and data derived by the enabled stages
+
+    inline
+    uint64_t EstimateGeometryWorkingSet(const InGeometry& geometry, const ProcessSettings& settings)
+    {
+        uint64_t vertex_count = geometry.positions.count;
+        uint64_t index_count = geometry.indices.count;
+
+        uint64_t input = vertex_count * sizeof(glm::vec3)
+            + geometry.normals.count * sizeof(glm::vec3)
+            + geometry.tex_coords.count * sizeof(glm::vec2)
+            + index_count * sizeof(uint32_t);
+
+        uint64_t output = vertex_count * GeometryVertexBytes + index_count * sizeof(uint32_t);
+
+        uint64_t scratch = vertex_count * (sizeof(VertexBasis) + sizeof(uint32_t)) + index_count * sizeof(uint32_t);
+
+        uint64_t derived = 0;
+        if (settings.lod_count) {
+            derived += index_count * sizeof(uint32_t);
+        }
+        if (settings.generate_meshlets) {
+            derived += index_count * sizeof(uint32_t);
+        }
+        if (settings.generate_cluster_lods) {
+            derived += 2 * index_count * sizeof(uint32_t);
+        }
+        if (settings.quantize_positions) {
+
+            // Offsets per vertex, or per meshlet and cluster vertex when those are generated
+            //  (bounded by their index counts above), at the 32 bit fallback width
+
+            uint64_t quantized_count = vertex_count;
+            if (settings.generate_meshlets || settings.generate_cluster_lods) {
+                quantized_count = (settings.generate_meshlets ? index_count : 0)
+                    + (settings.generate_cluster_lods ? 2 * index_count : 0);
+            }
+            derived += quantized_count * sizeof(Vec3<uint32_t>);
+        }
+
+        return input + output + scratch + derived;
+    }
+
+    struct GeometryBatchInfo
+    {
+        uint32_t first;
+        uint32_t count;
+        uint64_t working_set;
+    };
+
+    // Groups consecutive geometries into batches within the stream memory budget
+
+    inline
+    std::vector<GeometryBatchInfo> PlanGeometryBatches(Importer& importer)
+    {
+        auto& settings = importer.settings;
+        auto& geometries = importer.geometries;
+
+        std::vector<GeometryBatchInfo> batches;
+
+        for (uint32_t i = 0; i < geometries.size(); ++i) {
+            uint64_t working_set = EstimateGeometryWorkingSet(geometries[i], settings);
+
+            if (working_set > settings.stream_memory_budget) {
+                fmt::println("Geometry {} needs an estimated {} bytes, exceeding the stream memory budget of {}",
+                    i, working_set, settings.stream_memory_budget);
+            }
+
+            if (batches.empty() || (batches.back().count && batches.back().working_set + working_set > settings.stream_memory_budget)) {
+                batches.push_back(GeometryBatchInfo { .first = i });
+            }
+
+            batches.back().count++;
+            batches.back().working_set += working_set;
+        }
+
+        return batches;
+    }
+}
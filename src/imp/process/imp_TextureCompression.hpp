@@ -0,0 +1,639 @@
+#pragma once
+
+#include <imp/imp_Importer.hpp>
+
+#include "imp_ChannelKernels.hpp"
+#include "imp_ImageResample.hpp"
+
+#include <bc7enc.h>
+
+namespace imp::detail
+{
+    inline
+    bool IsBlockCompressed(TextureFormat format) noexcept
+    {
+        switch (format) {
+                using enum TextureFormat;
+            break;case RGBA8_SRGB:
+                  case RGBA8_UNORM:
+                  case RG8_UNORM:
+                  case R8_UNORM:
+                  case RGBA16_SFLOAT:
+                return false;
+            break;case BC7_SRGB:
+                  case BC7_UNORM:
+                  case BC5_UNORM:
+                  case BC4_UNORM:
+                  case BC6H_UFLOAT:
+                  case BC6H_SFLOAT:
+                return true;
+        }
+        std::unreachable();
+    }
+
+    // HDR formats, processed from float data
+
+    inline
+    bool IsFloatFormat(TextureFormat format) noexcept
+    {
+        switch (format) {
+                using enum TextureFormat;
+            break;case RGBA16_SFLOAT:
+                  case BC6H_UFLOAT:
+                  case BC6H_SFLOAT:
+                return true;
+            break;default:
+                return false;
+        }
+    }
+
+    // Uncompressed format of the 8 bit or float data a format is processed in
+
+    inline
+    TextureFormat GetProcessFormat(TextureFormat format) noexcept
+    {
+        switch (format) {
+                using enum TextureFormat;
+            break;case BC7_SRGB:    return RGBA8_SRGB;
+            break;case BC7_UNORM:   return RGBA8_UNORM;
+            break;case BC5_UNORM:   return RG8_UNORM;
+            break;case BC4_UNORM:   return R8_UNORM;
+            break;case BC6H_UFLOAT:
+                  case BC6H_SFLOAT: return RGBA16_SFLOAT;
+            break;default:          return format;
+        }
+    }
+
+    // Block compressed format used for an uncompressed format when compression is enabled
+
+    inline
+    TextureFormat GetCompressedFormat(TextureFormat format) noexcept
+    {
+        switch (format) {
+                using enum TextureFormat;
+            break;case RGBA8_SRGB:    return BC7_SRGB;
+            break;case RGBA8_UNORM:   return BC7_UNORM;
+            break;case RG8_UNORM:     return BC5_UNORM;
+            break;case R8_UNORM:      return BC4_UNORM;
+            break;case RGBA16_SFLOAT: return BC6H_UFLOAT;
+            break;default:            return format;
+        }
+    }
+
+    inline
+    uint32_t GetBlockBytes(TextureFormat format) noexcept
+    {
+        switch (format) {
+                using enum TextureFormat;
+            break;case BC7_SRGB:
+                  case BC7_UNORM:
+                  case BC5_UNORM:
+                  case BC6H_UFLOAT:
+                  case BC6H_SFLOAT:
+                return 16;
+            break;case BC4_UNORM:
+                  case RGBA16_SFLOAT:
+                return 8;
+            break;default:
+                return GetChannelCount(format);
+        }
+    }
+
+    inline
+    uint64_t GetLevelBytes(glm::uvec2 size, TextureFormat format) noexcept
+    {
+        uint32_t block_dim = IsBlockCompressed(format) ? 4 : 1;
+        return uint64_t((size.x + block_dim - 1) / block_dim) * ((size.y + block_dim - 1) / block_dim) * GetBlockBytes(format);
+    }
+
+    inline
+    uint64_t GetTextureBytes(glm::uvec2 size, TextureFormat format, uint32_t mip_count) noexcept
+    {
+        uint64_t bytes = 0;
+        for (uint32_t level = 0; level < mip_count; ++level) {
+            bytes += GetLevelBytes(GetMipSize(size, level), format);
+        }
+        return bytes;
+    }
+
+    // Fills in the block layout and mip offsets of a texture, returns the total data size
+
+    inline
+    uint64_t LayoutTexture(MemoryPool& memory_pool, Texture& texture)
+    {
+        uint32_t block_dim = IsBlockCompressed(texture.format) ? 4 : 1;
+        texture.block_extent = { block_dim, block_dim };
+        texture.block_bytes = GetBlockBytes(texture.format);
+        texture.mip_offsets = { memory_pool.Allocate<uint64_t>(texture.mip_count), texture.mip_count };
+
+        uint64_t offset = 0;
+        for (uint32_t level = 0; level < texture.mip_count; ++level) {
+            texture.mip_offsets[level] = offset;
+            offset += GetLevelBytes(GetMipSize(texture.size, level), texture.format);
+        }
+        return offset;
+    }
+
+// -----------------------------------------------------------------------------
+
+    // Float to half with round to nearest even, overflow saturates to infinity
+
+    inline
+    uint16_t FloatToHalf(float value) noexcept
+    {
+        uint32_t bits = std::bit_cast<uint32_t>(value);
+        uint32_t sign = (bits >> 16) & 0x8000;
+        bits &= 0x7FFF'FFFF;
+
+        if (bits >= 0x7F80'0000) {
+            return uint16_t(sign | (bits > 0x7F80'0000 ? 0x7E00 : 0x7C00));
+        }
+        if (bits >= 0x477F'F000) {
+            return uint16_t(sign | 0x7C00);
+        }
+
+        // Subnormal results, adding 0.5 aligns the mantissa so the float add does the rounding
+
+        if (bits < 0x3880'0000) {
+            float aligned = std::bit_cast<float>(bits) + 0.5f;
+            return uint16_t(sign | (std::bit_cast<uint32_t>(aligned) - 0x3F00'0000));
+        }
+
+        bits += 0xC800'0FFF + ((bits >> 13) & 1);
+        return uint16_t(sign | (bits >> 13));
+    }
+
+    inline
+    float HalfToFloat(uint16_t half) noexcept
+    {
+        uint32_t sign = uint32_t(half & 0x8000) << 16;
+        uint32_t exponent = (half >> 10) & 0x1F;
+        uint32_t mantissa = half & 0x3FF;
+
+        if (exponent == 0) {
+            float value = float(mantissa) * 0x1p-24f;
+            return sign ? -value : value;
+        }
+        if (exponent == 31) {
+            return std::bit_cast<float>(sign | 0x7F80'0000 | (mantissa << 13));
+        }
+        return std::bit_cast<float>(sign | ((exponent + 112) << 23) | (mantissa << 13));
+    }
+
+    inline
+    void ConvertToHalf(const float* values, uint64_t count, std::byte* out, bool parallel)
+    {
+#pragma omp parallel for schedule(static) if(parallel)
+        for (int64_t i = 0; i < int64_t(count); ++i) {
+            uint16_t half = FloatToHalf(values[i]);
+            std::memcpy(out + i * 2, &half, 2);
+        }
+    }
+
+// -----------------------------------------------------------------------------
+
+    // BC4 encoding. Both endpoint orderings are evaluated: 8 interpolated values, or 6 plus
+    //  exact 0 and 255. Higher quality refines endpoints around the initial extents.
+
+    inline
+    void DecodeBC4Palette(uint8_t r0, uint8_t r1, std::array<uint8_t, 8>& palette) noexcept
+    {
+        palette[0] = r0;
+        palette[1] = r1;
+        if (r0 > r1) {
+            for (uint32_t k = 1; k < 7; ++k) {
+                palette[k + 1] = uint8_t(((7 - k) * r0 + k * r1 + 3) / 7);
+            }
+        } else {
+            for (uint32_t k = 1; k < 5; ++k) {
+                palette[k + 1] = uint8_t(((5 - k) * r0 + k * r1 + 2) / 5);
+            }
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+    }
+
+    inline
+    uint32_t EvaluateBC4Block(const uint8_t* values, uint8_t r0, uint8_t r1, uint64_t& selectors) noexcept
+    {
+        std::array<uint8_t, 8> palette;
+        DecodeBC4Palette(r0, r1, palette);
+
+        uint32_t total_error = 0;
+        selectors = 0;
+        for (uint32_t i = 0; i < 16; ++i) {
+            uint32_t best_error = UINT32_MAX;
+            uint32_t best = 0;
+            for (uint32_t k = 0; k < 8; ++k) {
+                int32_t d = int32_t(values[i]) - int32_t(palette[k]);
+                if (uint32_t(d * d) < best_error) {
+                    best_error = uint32_t(d * d);
+                    best = k;
+                }
+            }
+            total_error += best_error;
+            selectors |= uint64_t(best) << (i * 3);
+        }
+        return total_error;
+    }
+
+    inline
+    void EncodeBC4Block(const uint8_t* values, uint8_t* out, TextureCompressionQuality quality) noexcept
+    {
+        uint8_t min = 255, max = 0;
+        uint8_t inner_min = 255, inner_max = 0;
+        for (uint32_t i = 0; i < 16; ++i) {
+            min = std::min(min, values[i]);
+            max = std::max(max, values[i]);
+            if (values[i] != 0 && values[i] != 255) {
+                inner_min = std::min(inner_min, values[i]);
+                inner_max = std::max(inner_max, values[i]);
+            }
+        }
+
+        uint32_t best_error = UINT32_MAX;
+        uint8_t best_r0 = 0, best_r1 = 0;
+        uint64_t best_selectors = 0;
+
+        auto try_endpoints = [&](int32_t r0, int32_t r1) {
+            if (r0 < 0 || r0 > 255 || r1 < 0 || r1 > 255) {
+                return;
+            }
+            uint64_t selectors;
+            uint32_t error = EvaluateBC4Block(values, uint8_t(r0), uint8_t(r1), selectors);
+            if (error < best_error) {
+                best_error = error;
+                best_r0 = uint8_t(r0);
+                best_r1 = uint8_t(r1);
+                best_selectors = selectors;
+            }
+        };
+
+        // 8 value mode requires r0 > r1, 6 value mode r0 <= r1
+
+        try_endpoints(max, min);
+        if (quality != TextureCompressionQuality::Fast && inner_min <= inner_max) {
+            try_endpoints(inner_min, inner_max);
+        }
+
+        if (quality == TextureCompressionQuality::Best && best_error) {
+            constexpr int32_t Radius = 3;
+            int32_t r0 = best_r0, r1 = best_r1;
+            for (int32_t d0 = -Radius; d0 <= Radius; ++d0) {
+                for (int32_t d1 = -Radius; d1 <= Radius; ++d1) {
+                    if ((r0 + d0 > r1 + d1) == (r0 > r1)) {
+                        try_endpoints(r0 + d0, r1 + d1);
+                    }
+                }
+            }
+        }
+
+        out[0] = best_r0;
+        out[1] = best_r1;
+        for (uint32_t i = 0; i < 6; ++i) {
+            out[2 + i] = uint8_t(best_selectors >> (i * 8));
+        }
+    }
+
+// -----------------------------------------------------------------------------
+
+    inline
+    void InitBC7Encoder()
+    {
+        static bool initialized = [] {
+            bc7enc_compress_block_init();
+            return true;
+        }();
+        (void)initialized;
+    }
+
+    inline
+    bc7enc_compress_block_params GetBC7Params(TextureCompressionQuality quality, bool perceptual)
+    {
+        bc7enc_compress_block_params params;
+        bc7enc_compress_block_params_init(&params);
+        if (!perceptual) {
+            bc7enc_compress_block_params_init_linear_weights(&params);
+        }
+
+        switch (quality) {
+            break;case TextureCompressionQuality::Fast:
+                params.m_uber_level = 0;
+                params.m_max_partitions = 16;
+            break;case TextureCompressionQuality::Normal:
+                params.m_uber_level = 1;
+                params.m_max_partitions = BC7ENC_MAX_PARTITIONS;
+            break;case TextureCompressionQuality::Best:
+                params.m_uber_level = BC7ENC_MAX_UBER_LEVEL;
+                params.m_max_partitions = BC7ENC_MAX_PARTITIONS;
+                params.m_try_least_squares = true;
+        }
+
+        return params;
+    }
+
+// -----------------------------------------------------------------------------
+
+    // BC6H encoding, all blocks use mode 11: one region with 10 bit endpoints and 4 bit indices.
+    //  Endpoints are interpolated on half float bit patterns, which is roughly logarithmic, so
+    //  fitting happens on the bit patterns as signed integers.
+
+    constexpr std::array<int32_t, 16> BC6HWeights = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    constexpr int32_t BC6HMaxValue = 0x7BFF;
+
+    inline
+    int32_t ToBC6HValue(float value, bool is_signed) noexcept
+    {
+        uint16_t half = FloatToHalf(is_signed ? value : std::max(value, 0.f));
+        int32_t magnitude = std::min(int32_t(half & 0x7FFF), BC6HMaxValue);
+        return (half & 0x8000) ? -magnitude : magnitude;
+    }
+
+    inline
+    int32_t UnquantizeBC6H(int32_t endpoint, bool is_signed) noexcept
+    {
+        if (endpoint == 0) {
+            return 0;
+        }
+        if (!is_signed) {
+            return endpoint == 1023 ? 0xFFFF : ((endpoint << 16) + 0x8000) >> 10;
+        }
+        int32_t magnitude = std::abs(endpoint);
+        int32_t value = magnitude >= 511 ? 0x7FFF : ((magnitude << 15) + 0x4000) >> 9;
+        return endpoint < 0 ? -value : value;
+    }
+
+    inline
+    int32_t FinishBC6H(int32_t value, bool is_signed) noexcept
+    {
+        if (!is_signed) {
+            return (value * 31) >> 6;
+        }
+        return value < 0 ? -(((-value) * 31) >> 5) : (value * 31) >> 5;
+    }
+
+    // Closest 10 bit endpoint to a half bit pattern value
+
+    inline
+    int32_t QuantizeBC6HEndpoint(float value, bool is_signed) noexcept
+    {
+        int32_t min = is_signed ? -512 : 0;
+        int32_t max = is_signed ? 511 : 1023;
+        int32_t target = int32_t(std::lround(std::clamp(value, is_signed ? -float(BC6HMaxValue) : 0.f, float(BC6HMaxValue))));
+        int32_t guess = int32_t(std::lround(float(target) * float(max) / float(BC6HMaxValue)));
+
+        int32_t best = 0;
+        int32_t best_error = INT32_MAX;
+        for (int32_t endpoint = std::max(guess - 2, min); endpoint <= std::min(guess + 2, max); ++endpoint) {
+            int32_t error = std::abs(FinishBC6H(UnquantizeBC6H(endpoint, is_signed), is_signed) - target);
+            if (error < best_error) {
+                best_error = error;
+                best = endpoint;
+            }
+        }
+        return best;
+    }
+
+    struct BC6HEndpoints
+    {
+        std::array<glm::ivec3, 2> quantized;
+        std::array<uint8_t, 16>   indices;
+        int64_t                   error;
+    };
+
+    inline
+    void EvaluateBC6HBlock(const std::array<glm::ivec3, 16>& values, bool is_signed, BC6HEndpoints& endpoints) noexcept
+    {
+        std::array<glm::ivec3, 2> unquantized;
+        for (uint32_t e = 0; e < 2; ++e) {
+            for (uint32_t c = 0; c < 3; ++c) {
+                unquantized[e][c] = UnquantizeBC6H(endpoints.quantized[e][c], is_signed);
+            }
+        }
+
+        std::array<glm::ivec3, 16> palette;
+        for (uint32_t k = 0; k < 16; ++k) {
+            for (uint32_t c = 0; c < 3; ++c) {
+                int32_t value = ((64 - BC6HWeights[k]) * unquantized[0][c] + BC6HWeights[k] * unquantized[1][c] + 32) >> 6;
+                palette[k][c] = FinishBC6H(value, is_signed);
+            }
+        }
+
+        endpoints.error = 0;
+        for (uint32_t i = 0; i < 16; ++i) {
+            int64_t best_error = INT64_MAX;
+            for (uint32_t k = 0; k < 16; ++k) {
+                int64_t error = 0;
+                for (uint32_t c = 0; c < 3; ++c) {
+                    int64_t d = values[i][c] - palette[k][c];
+                    error += d * d;
+                }
+                if (error < best_error) {
+                    best_error = error;
+                    endpoints.indices[i] = uint8_t(k);
+                }
+            }
+            endpoints.error += best_error;
+        }
+    }
+
+    // Fits endpoints to the extents of the block along its principal axis, then refines them
+    //  with least squares against the chosen indices
+
+    inline
+    void EncodeBC6HBlock(const std::array<glm::vec3, 16>& pixels, bool is_signed, uint8_t* out, TextureCompressionQuality quality) noexcept
+    {
+        std::array<glm::ivec3, 16> values;
+        glm::vec3 mean = {};
+        for (uint32_t i = 0; i < 16; ++i) {
+            for (uint32_t c = 0; c < 3; ++c) {
+                values[i][c] = ToBC6HValue(pixels[i][c], is_signed);
+            }
+            mean += glm::vec3(values[i]);
+        }
+        mean /= 16.f;
+
+        std::array<float, 6> covariance = {};
+        for (uint32_t i = 0; i < 16; ++i) {
+            glm::vec3 d = glm::vec3(values[i]) - mean;
+            covariance[0] += d.x * d.x;
+            covariance[1] += d.x * d.y;
+            covariance[2] += d.x * d.z;
+            covariance[3] += d.y * d.y;
+            covariance[4] += d.y * d.z;
+            covariance[5] += d.z * d.z;
+        }
+
+        glm::vec3 axis = { 1.f, 1.f, 1.f };
+        for (uint32_t iteration = 0; iteration < 8; ++iteration) {
+            glm::vec3 next = {
+                covariance[0] * axis.x + covariance[1] * axis.y + covariance[2] * axis.z,
+                covariance[1] * axis.x + covariance[3] * axis.y + covariance[4] * axis.z,
+                covariance[2] * axis.x + covariance[4] * axis.y + covariance[5] * axis.z,
+            };
+            float length = std::sqrt(next.x * next.x + next.y * next.y + next.z * next.z);
+            if (length < 1e-6f) {
+                break;
+            }
+            axis = next / length;
+        }
+
+        float t_min = 0.f, t_max = 0.f;
+        for (uint32_t i = 0; i < 16; ++i) {
+            glm::vec3 d = glm::vec3(values[i]) - mean;
+            float t = d.x * axis.x + d.y * axis.y + d.z * axis.z;
+            t_min = std::min(t_min, t);
+            t_max = std::max(t_max, t);
+        }
+
+        auto quantize = [&](glm::vec3 low, glm::vec3 high) {
+            BC6HEndpoints endpoints;
+            for (uint32_t c = 0; c < 3; ++c) {
+                endpoints.quantized[0][c] = QuantizeBC6HEndpoint(low[c], is_signed);
+                endpoints.quantized[1][c] = QuantizeBC6HEndpoint(high[c], is_signed);
+            }
+            EvaluateBC6HBlock(values, is_signed, endpoints);
+            return endpoints;
+        };
+
+        BC6HEndpoints best = quantize(mean + axis * t_min, mean + axis * t_max);
+
+        uint32_t refinements = 0;
+        switch (quality) {
+            break;case TextureCompressionQuality::Fast:   refinements = 0;
+            break;case TextureCompressionQuality::Normal: refinements = 1;
+            break;case TextureCompressionQuality::Best:   refinements = 4;
+        }
+
+        for (uint32_t iteration = 0; iteration < refinements && best.error; ++iteration) {
+            float aa = 0.f, ab = 0.f, bb = 0.f;
+            glm::vec3 ax = {}, bx = {};
+            for (uint32_t i = 0; i < 16; ++i) {
+                float b = float(BC6HWeights[best.indices[i]]) / 64.f;
+                float a = 1.f - b;
+                aa += a * a;
+                ab += a * b;
+                bb += b * b;
+                ax += a * glm::vec3(values[i]);
+                bx += b * glm::vec3(values[i]);
+            }
+
+            float det = aa * bb - ab * ab;
+            if (std::abs(det) < 1e-6f) {
+                break;
+            }
+
+            auto candidate = quantize((ax * bb - bx * ab) / det, (bx * aa - ax * ab) / det);
+            if (candidate.error >= best.error) {
+                break;
+            }
+            best = candidate;
+        }
+
+        // The first index drops its high bit, swap endpoints so it is clear
+
+        if (best.indices[0] & 8) {
+            std::swap(best.quantized[0], best.quantized[1]);
+            for (auto& index : best.indices) {
+                index = uint8_t(15 - index);
+            }
+        }
+
+        std::array<uint64_t, 2> block = {};
+        uint32_t position = 0;
+        auto write = [&](uint32_t value, uint32_t bits) {
+            for (uint32_t b = 0; b < bits; ++b, ++position) {
+                block[position / 64] |= uint64_t((value >> b) & 1) << (position % 64);
+            }
+        };
+
+        write(0x03, 5);
+        for (uint32_t e = 0; e < 2; ++e) {
+            for (uint32_t c = 0; c < 3; ++c) {
+                write(uint32_t(best.quantized[e][c]) & 0x3FF, 10);
+            }
+        }
+        for (uint32_t i = 0; i < 16; ++i) {
+            write(best.indices[i], i == 0 ? 3 : 4);
+        }
+
+        std::memcpy(out, block.data(), 16);
+    }
+
+    // Compresses one level of 8 bit data in the format's process layout, in parallel over
+    //  rows of blocks. Edge blocks replicate the last row / column.
+
+    inline
+    void CompressImage(const uint8_t* pixels, glm::uvec2 size, TextureFormat format, TextureCompressionQuality quality, std::byte* out, bool parallel)
+    {
+        uint32_t channels = GetChannelCount(format);
+        uint32_t block_bytes = GetBlockBytes(format);
+        uint32_t blocks_x = (size.x + 3) / 4;
+        uint32_t blocks_y = (size.y + 3) / 4;
+
+        bc7enc_compress_block_params bc7_params;
+        if (format == TextureFormat::BC7_SRGB || format == TextureFormat::BC7_UNORM) {
+            InitBC7Encoder();
+            bc7_params = GetBC7Params(quality, format == TextureFormat::BC7_SRGB);
+        }
+
+#pragma omp parallel for schedule(dynamic) if(parallel)
+        for (uint32_t by = 0; by < blocks_y; ++by) {
+            for (uint32_t bx = 0; bx < blocks_x; ++bx) {
+
+                // Gather the block, channel planar for BC4 / BC5 and interleaved for BC7
+
+                std::array<uint8_t, 64> block;
+                for (uint32_t i = 0; i < 16; ++i) {
+                    uint32_t x = std::min(bx * 4 + i % 4, size.x - 1);
+                    uint32_t y = std::min(by * 4 + i / 4, size.y - 1);
+                    const uint8_t* pixel = pixels + (uint64_t(y) * size.x + x) * channels;
+                    for (uint32_t c = 0; c < channels; ++c) {
+                        block[channels == 4 ? i * 4 + c : c * 16 + i] = pixel[c];
+                    }
+                }
+
+                auto* dst = reinterpret_cast<uint8_t*>(out) + (uint64_t(by) * blocks_x + bx) * block_bytes;
+                switch (format) {
+                    break;case TextureFormat::BC7_SRGB:
+                          case TextureFormat::BC7_UNORM:
+                        bc7enc_compress_block(dst, block.data(), &bc7_params);
+                    break;case TextureFormat::BC5_UNORM:
+                        EncodeBC4Block(&block[0], dst, quality);
+                        EncodeBC4Block(&block[16], dst + 8, quality);
+                    break;case TextureFormat::BC4_UNORM:
+                        EncodeBC4Block(&block[0], dst, quality);
+                    break;default:
+                        std::unreachable();
+                }
+            }
+        }
+    }
+
+    // Compresses one level of RGBA float data to BC6H in parallel over rows of blocks, alpha
+    //  is dropped
+
+    inline
+    void CompressImage(const float* pixels, glm::uvec2 size, TextureFormat format, TextureCompressionQuality quality, std::byte* out, bool parallel)
+    {
+        bool is_signed = format == TextureFormat::BC6H_SFLOAT;
+        uint32_t blocks_x = (size.x + 3) / 4;
+        uint32_t blocks_y = (size.y + 3) / 4;
+
+#pragma omp parallel for schedule(dynamic) if(parallel)
+        for (uint32_t by = 0; by < blocks_y; ++by) {
+            for (uint32_t bx = 0; bx < blocks_x; ++bx) {
+                std::array<glm::vec3, 16> block;
+                for (uint32_t i = 0; i < 16; ++i) {
+                    uint32_t x = std::min(bx * 4 + i % 4, size.x - 1);
+                    uint32_t y = std::min(by * 4 + i / 4, size.y - 1);
+                    const float* pixel = pixels + (uint64_t(y) * size.x + x) * 4;
+                    block[i] = { pixel[0], pixel[1], pixel[2] };
+                }
+
+                EncodeBC6HBlock(block, is_signed, reinterpret_cast<uint8_t*>(out) + (uint64_t(by) * blocks_x + bx) * 16, quality);
+            }
+        }
+    }
+}
@@ -0,0 +1,150 @@
+#include "imp/imp_BasisMathBatch.hpp"
+
+#include <fmt/printf.h>
+
+#include <random>
+
+// Checks the SIMD basis math batch kernels of every instruction set the CPU supports are
+//  bit-identical to the scalar functions: every quantized normal, 1M random bases and kernel
+//  chains, and every float bit pattern through the half packing. Exits non-zero on mismatch.
+
+using namespace imp;
+using namespace imp::detail;
+
+// Counts outputs of a kernel set that differ bitwise from the scalar functions
+
+static uint64_t VerifyBasisBatchKernels(const BasisBatchKernels& kernels)
+{
+    uint64_t mismatches = 0;
+
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> dist(-2.f, 2.f);
+
+    auto random_vec = [&] {
+        return glm::vec3(dist(rng), dist(rng), dist(rng));
+    };
+
+    // Random components with a share of signed zeros
+
+    auto random_component = [&] {
+        float v = dist(rng);
+        uint32_t c = rng() % 8;
+        return c == 0 ? 0.f : c == 1 ? -0.f : v;
+    };
+
+    auto bits = [](glm::vec3 v) {
+        return std::bit_cast<std::array<uint32_t, 3>>(v);
+    };
+
+    auto verify_bases = [&](auto&& generate) {
+        VertexBasisBatch batch;
+        VertexBasis bases[BasisBatchSize];
+        for (uint32_t k = 0; k < BasisBatchSize; ++k) {
+            bases[k] = generate(k);
+            batch.Set(k, bases[k]);
+        }
+        Basis out[BasisBatchSize];
+        kernels.quantize_basis(batch, out, BasisBatchSize);
+        for (uint32_t k = 0; k < BasisBatchSize; ++k) {
+            mismatches += std::bit_cast<uint32_t>(QuantizeBasis(bases[k])) != std::bit_cast<uint32_t>(out[k]);
+        }
+    };
+
+    // Every quantized normal, perturbed per lane, with random tangent frames
+
+    for (uint32_t s = 0; s < 2; ++s) {
+        for (uint32_t x = 0; x < 1024; ++x) {
+            for (uint32_t y = 0; y < 1024; ++y) {
+                auto normal = SignedOctDecode({ float(x) / 1023.f, float(y) / 1023.f, float(s) });
+                verify_bases([&](uint32_t k) {
+                    return VertexBasis { normal + random_vec() * 1e-3f * float(k), random_vec(), random_vec() };
+                });
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < (1u << 20); ++i) {
+        verify_bases([&](uint32_t) {
+            return VertexBasis {
+                { random_component(), random_component(), random_component() },
+                { random_component(), random_component(), random_component() },
+                { random_component(), random_component(), random_component() },
+            };
+        });
+    }
+
+    // Individual kernels chained on random unit normals and tangents
+
+    for (uint32_t i = 0; i < (1u << 20); ++i) {
+        Vec3Batch normals, encoded, decoded, tangents;
+        for (uint32_t k = 0; k < BasisBatchSize; ++k) {
+            normals.Set(k, glm::normalize(random_vec()));
+            tangents.Set(k, random_vec());
+        }
+
+        kernels.signed_oct_encode(normals, encoded);
+        kernels.signed_oct_decode(encoded, decoded);
+
+        float diamonds[BasisBatchSize];
+        kernels.encode_tangent(decoded, tangents, diamonds);
+
+        Vec2Batch diamond_vecs;
+        kernels.decode_diamond(diamonds, diamond_vecs);
+
+        for (uint32_t k = 0; k < BasisBatchSize; ++k) {
+            mismatches += bits(SignedOctEncode(normals.Get(k))) != bits(encoded.Get(k));
+            mismatches += bits(SignedOctDecode(encoded.Get(k))) != bits(decoded.Get(k));
+            mismatches += std::bit_cast<uint32_t>(EncodeTangent(decoded.Get(k), tangents.Get(k))) != std::bit_cast<uint32_t>(diamonds[k]);
+            auto v = DecodeDiamond(diamonds[k]);
+            mismatches += std::bit_cast<uint32_t>(v.x) != std::bit_cast<uint32_t>(diamond_vecs.x[k])
+                || std::bit_cast<uint32_t>(v.y) != std::bit_cast<uint32_t>(diamond_vecs.y[k]);
+        }
+    }
+
+    // Every float bit pattern through the half packing
+
+    uint64_t half_mismatches = 0;
+
+#pragma omp parallel for schedule(dynamic) reduction(+: half_mismatches)
+    for (uint32_t high = 0; high < (1u << 16); ++high) {
+        glm::vec2 in[BasisBatchSize];
+        Vec2<Float16> out[BasisBatchSize];
+        for (uint32_t low = 0; low < (1u << 16); low += 2 * BasisBatchSize) {
+            for (uint32_t k = 0; k < 2 * BasisBatchSize; ++k) {
+                in[k / 2][k % 2] = std::bit_cast<float>(high << 16 | (low + k));
+            }
+            kernels.pack_half_2x16(in, out, BasisBatchSize);
+            for (uint32_t k = 0; k < BasisBatchSize; ++k) {
+                half_mismatches += std::bit_cast<uint32_t>(out[k]) != glm::packHalf2x16(in[k]);
+            }
+        }
+    }
+
+    return mismatches + half_mismatches;
+}
+
+int main()
+{
+    auto candidates = GetSimdBasisBatchKernels();
+    if (candidates.empty()) {
+        fmt::println("No SIMD basis math batch kernels supported, nothing to verify");
+        return 0;
+    }
+
+    uint64_t mismatches = 0;
+    for (auto* kernels : candidates) {
+        using namespace std::chrono;
+        auto start = steady_clock::now();
+
+        uint64_t kernel_mismatches = VerifyBasisBatchKernels(*kernels);
+        mismatches += kernel_mismatches;
+
+        auto end = steady_clock::now();
+
+        fmt::println("Verified {} basis math batch kernels{}, {} mismatches in {} ms",
+            kernels->name, kernels == &GetBasisBatchKernels() ? " (selected)" : "", kernel_mismatches,
+            duration_cast<milliseconds>(end - start).count());
+    }
+
+    return mismatches ? 1 : 0;
+}